@@ -3,37 +3,221 @@
 #ifndef ALLOCATOR_H
 #define ALLOCATOR_H
 
-#include <list>
+#include <cstdint>
+#include <memory>
+#include <vector>
 #include "block.h"
+#include "block_arena.h"
+#include "buddy_allocator.h"
+#include "free_tree.h"
+#include "id_table.h"
+#include "slab_allocator.h"
+#include "snapshot.h"
+#include "tlsf_index.h"
+
+// Allocation strategies, for callers that pick one at run time
+enum AllocationStrategy {
+    FIRST_FIT,
+    NEXT_FIT,
+    BEST_FIT,
+    WORST_FIT,
+    TLSF,
+    BUDDY
+};
+
+// Snapshot of the allocator statistics, every field is maintained incrementally
+struct AllocatorStats {
+    mem_size_t totalSize;
+    mem_size_t usedBytes;
+    mem_size_t freeBytes;
+    int freeBlocks;
+    mem_size_t largestFreeBlock;
+    mem_size_t internalFragmentation;
+    int64_t allocRequests;
+    int64_t allocFailures;
+    int64_t compactions;
+    mem_size_t compactedBytes;      // bytes moved over all compactions
+    int64_t reallocs;               // successful reallocations
+    int64_t reallocsInPlace;
+    mem_size_t reallocCopiedBytes;  // bytes copied by reallocations that moved
+    mem_size_t alignmentPadding;    // padding in front of live allocations of the list, part of internal fragmentation
+    mem_size_t headerBytes;         // headers and footers of live allocations of the list, part of internal fragmentation
+};
+
+// Outcome of one compaction
+struct CompactionResult {
+    std::vector<Relocation> relocations;    // every allocation that moved, in address order
+    mem_size_t bytesMoved;
+};
 
 class Allocator {
 private:
-    int totalSize;              // total memory size
-    std::list<Block> blocks;    // list of memory blocks
-    int nextId;
-    int allocRequests;
-    int allocFailures;
+    mem_size_t totalSize;       // total memory size
+    BlockArena blocks;          // memory blocks in address order
+    alloc_id_t nextId;
+    int64_t allocRequests;
+    int64_t allocFailures;
+    int64_t compactions;
+    mem_size_t compactedBytes;
+    int64_t reallocs;
+    int64_t reallocsInPlace;
+    mem_size_t reallocCopiedBytes;
+
+    // Index of free blocks ordered by (size, start), used by best fit
+    SizeTree freeBySize;
+
+    // Index of free blocks ordered by address, used by first fit, next fit and worst fit
+    FreeTree freeByAddress;
+
+    // Two-level segregated fit bins of free blocks, used by TLSF
+    TlsfIndex freeBins;
+
+    // Next fit resumes its search from this address
+    mem_size_t rover;
+
+    // Buddy engine, created on the first buddy request inside a pool carved from this address space
+    std::unique_ptr<BuddyAllocator> buddy;
+
+    // Size-class front end, set up by configureSlabs; small requests of every fit strategy go here
+    std::unique_ptr<SlabAllocator> slabs;
+
+    // Allocation ID -> block, filled on allocation and cleared on free
+    IdTable idToBlock;
+
+    // Compact when a fit fails, see compactFor
+    bool autoCompact;
+
+    // Block layout, see configureLayout
+    mem_size_t headerSize;
+    mem_size_t footerSize;
+    mem_size_t defaultAlignment;
+    mem_size_t paddingBytes;        // alignment padding of the allocated blocks of the list
+    mem_size_t headerBytes;         // headers and footers of the allocated blocks of the list
+
+    // Totals over the free blocks of the list, updated with the free block indexes
+    mem_size_t freeBytes;
+    int freeBlockCount;
+    std::vector<int> freeHistogram;     // bucket i counts free blocks of size [2^i, 2^(i+1))
+
+    // Keep the free block indexes in sync with the block list
+    void addFreeIndex(uint32_t b);
+    void removeFreeIndex(uint32_t b);
+    void moveFreeIndex(uint32_t from, uint32_t to);   // free block `to` takes the place of `from`
+
+    // Take req_size bytes from the front of the free block b, splitting off the remainder
+    void carve(uint32_t b, mem_size_t req_size);
+
+    // Free block size that fits req_size bytes with header and footer if its start needs no padding
+    // alignment 0 is replaced by the default; -1 if alignment is not a power of two up to MAX_ALIGNMENT
+    // A block of fitSize + alignment - 1 bytes fits whatever its start
+    mem_size_t fitSize(mem_size_t req_size, mem_size_t &alignment) const;
+
+    // True if the free block b holds req_size bytes with header, footer and the padding its own start needs
+    bool fits(uint32_t b, mem_size_t req_size, mem_size_t alignment) const;
+
+    // Pad to the alignment, carve() the block with header and footer, and assign a new allocation ID
+    alloc_id_t allocateFrom(uint32_t b, mem_size_t req_size, mem_size_t alignment);
+
+    // Alignment bytes in front of the header of the allocated block b
+    mem_size_t paddingOf(uint32_t b) const;
+
+    // Payload bytes of the allocated block b
+    mem_size_t payloadSize(uint32_t b) const;
+
+    // Reserve the largest power-of-two block that fits as the buddy pool
+    bool reserveBuddyPool();
+
+    // Serve a request that fits a slab class, carving a new slab first fit if the class is full
+    alloc_id_t allocateSmall(mem_size_t req_size);
+
+    // Auto-compaction: if it is enabled and the free bytes cover req_size, compact and set b to the merged free block
+    bool compactFor(mem_size_t req_size, uint32_t &b);
+
+    // Shrink or grow block b without moving it, false if the next block cannot supply the extra bytes
+    bool resizeInPlace(uint32_t b, mem_size_t new_size);
+
+    // Move allocation `from` to ID `to`, whichever engine holds it
+    void renameAllocation(alloc_id_t from, alloc_id_t to);
+
+    // Return block b to the free space
+    void releaseBlock(uint32_t b);
 
     // Coalesce neighbour blocks if they are free after deallocation
-    void coalesce(std::list<Block>::iterator it);
+    void coalesce(uint32_t b);
 
 public:
+    static const alloc_id_t BUDDY_POOL_ID=-2;   // id of the block that holds the buddy pool
+    static const int BUDDY_MIN_BLOCK=16;        // smallest buddy block size
+    static const int BUDDY_MAX_BLOCKS_LOG2=24;  // larger pools raise the smallest block size instead
+    static const alloc_id_t SLAB_ID=-3;         // id of blocks that hold a slab
+    static const int HISTOGRAM_BUCKETS=63;      // one bucket per bit of a positive 64-bit size
+    static const mem_size_t MAX_ALIGNMENT=1<<20;    // also the largest header or footer
+
     // constructor
-    Allocator(int size);
+    Allocator(mem_size_t size);
+
+    // Enable the slab front end, classSizes must be increasing and no larger than slabSize
+    // Can only be done once, returns false for an invalid configuration
+    bool configureSlabs(const std::vector<int> &classSizes, int slabSize);
+
+    // Give every allocation of the list a header and a footer, and align payloads to `alignment` unless a request asks otherwise
+    // Header, footer and padding count as used memory and as internal fragmentation
+    // Only possible while nothing of the list is allocated, alignment must be a power of two; returns false otherwise
+    bool configureLayout(mem_size_t headerSize, mem_size_t footerSize, mem_size_t alignment);
+
+    // True if configureLayout accepts these values: header and footer from 0 to MAX_ALIGNMENT, alignment a power of two up to it
+    static bool validLayout(mem_size_t headerSize, mem_size_t footerSize, mem_size_t alignment);
+
+    // True for a power of two up to MAX_ALIGNMENT
+    static bool validAlignment(mem_size_t alignment);
 
     // allocation algorithms
-    int allocateFirstFit(int size);
-    int allocateBestFit(int size);
-    int allocateWorstFit(int size);
+    // alignment is a power of two for the payload address, 0 for the default of configureLayout (1 unless configured)
+    // Buddy blocks and slab objects have no header and ignore the alignment, they already round requests up
+    alloc_id_t allocateFirstFit(mem_size_t size, mem_size_t alignment=0);
+    alloc_id_t allocateBestFit(mem_size_t size, mem_size_t alignment=0);
+    alloc_id_t allocateWorstFit(mem_size_t size, mem_size_t alignment=0);
+    alloc_id_t allocateNextFit(mem_size_t size, mem_size_t alignment=0);
+    alloc_id_t allocateTlsf(mem_size_t size, mem_size_t alignment=0);
+    alloc_id_t allocateBuddy(mem_size_t size);
+    alloc_id_t allocate(AllocationStrategy strategy, mem_size_t size, mem_size_t alignment=0);
+
+    // Resize allocation id, keeping its ID
+    // Shrinks in place, grows in place into a free next block, otherwise moves it with the given strategy and its alignment
+    // Returns false if id is not allocated or no block fits, the allocation is then unchanged
+    bool reallocate(alloc_id_t id, mem_size_t newSize, AllocationStrategy strategy=FIRST_FIT);
+
+    // Slide every allocation toward address 0 and merge all free space into one block at the top
+    // Returns the old and new start of each moved allocation and the number of bytes copied
+    CompactionResult compact();
 
-    // deallocation
-    void freeBlock(int id);
+    // Compact automatically when a fit fails but enough free memory exists in total, off by default
+    void setAutoCompact(bool enabled);
+
+    // deallocation, returns false for an unknown or already freed ID
+    bool freeBlock(alloc_id_t id);
 
     // debugging or visualization
     void dumpMemory();
 
+    // O(1) statistics query, buddy pool free space counts as free memory
+    AllocatorStats getStats() const;
+
+    // Free block counts by power-of-two size bucket, including free buddy blocks
+    std::vector<int> getFreeHistogram() const;
+    void printFreeHistogram() const;
+
     // Calculates and Prints internal fragmentation, external fragmenation, allocation failure rate and memory utilization
     void printStats();
+
+    // Write the complete state to a binary snapshot: blocks, free indexes, buddy and slab engines, nextId and counters
+    // Returns false if the file cannot be written
+    bool saveSnapshot(const char *path) const;
+
+    // Replace the complete state with a snapshot written by saveSnapshot
+    // The file is memory-mapped and each array is copied out of it in one piece, nothing is parsed or rebuilt
+    // Returns false and leaves the allocator unchanged if the file cannot be read or is not a valid snapshot
+    bool loadSnapshot(const char *path);
 };
 
 #endif
@@ -3,11 +3,32 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
+#include <cstdint>
+
+typedef int64_t mem_size_t;     // simulated addresses and sizes, heaps can be larger than 4 GiB
+typedef int64_t alloc_id_t;     // allocation ids, long traces can issue more than 2^31 allocations
+
+// Largest allocation id a Block can hold, far beyond any trace: at 10^9 allocations a second it takes over two years
+const alloc_id_t MAX_ALLOC_ID=((alloc_id_t)1<<56)-1;
+
+// The id shares one word with the alignment and the free flag, so a record is 32 bytes
+// The alignment padding in front of an allocation's header is not stored, it follows from start and alignLog2
 struct Block {
-    int start;   // starting address of the block
-    int size;    // size of the block
-    bool free;   // true = free, false = allocated
-    int id;      // allocation id, -1 if free
+    mem_size_t start;       // starting address of the block
+    mem_size_t size;        // size of the block
+    alloc_id_t id:57;       // allocation id, -1 if free
+    uint64_t alignLog2:6;   // log2 of the alignment the allocation was made with, 0 for every other block
+    uint64_t free:1;        // 1 = free, 0 = allocated
+    uint32_t prev;          // arena index of the previous block in address order
+    uint32_t next;          // arena index of the next block in address order
+};
+static_assert(sizeof(Block)==32, "Block is meant to be 32 bytes");
+
+// One allocation moved by compaction
+struct Relocation {
+    alloc_id_t id;
+    mem_size_t oldStart;
+    mem_size_t newStart;
 };
 
 #endif
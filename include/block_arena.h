@@ -0,0 +1,47 @@
+// Defines the pooled store that holds all memory blocks
+
+#ifndef BLOCK_ARENA_H
+#define BLOCK_ARENA_H
+
+#include <cstdint>
+#include <vector>
+#include "block.h"
+#include "snapshot.h"
+
+// Contiguous array of Block records, linked in address order through 32-bit prev/next indices
+// Erased records are recycled, so splitting and merging blocks does not allocate once the arena is warm
+class BlockArena {
+public:
+    static constexpr uint32_t NONE=0xFFFFFFFFu;     // null index
+
+    BlockArena();
+
+    uint32_t first() const { return head; }
+    uint32_t size() const { return count; }
+    uint32_t capacity() const { return (uint32_t)records.size(); }   // linked and recycled records, every index is below it
+
+    Block &operator[](uint32_t i) { return records[i]; }
+    const Block &operator[](uint32_t i) const { return records[i]; }
+
+    // Link a copy of block right after pos, or at the front if pos is NONE
+    uint32_t insertAfter(uint32_t pos, const Block &block);
+
+    // Unlink block i and recycle its slot
+    void erase(uint32_t i);
+
+    // Drop all blocks
+    void clear();
+
+    // Copy the records and links as they are, so block indices stay valid across a restore
+    // load rejects links that leave the records, or lists that do not cover each record exactly once
+    void save(SnapshotWriter &out) const;
+    bool load(SnapshotReader &in);
+
+private:
+    std::vector<Block> records;
+    uint32_t head;
+    uint32_t freeSlots;     // chain of recycled slots, linked through next
+    uint32_t count;         // number of linked blocks
+};
+
+#endif
@@ -0,0 +1,93 @@
+// Defines the power-of-two buddy allocation engine
+
+#ifndef BUDDY_ALLOCATOR_H
+#define BUDDY_ALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "block.h"
+#include "snapshot.h"
+#include "id_table.h"
+
+// Manages a pool of 2^maxOrder bytes starting at address base
+// Requests are rounded up to a power of two (at least the minimum block size),
+// larger blocks are split in halves on allocation and buddies are merged back on free,
+// so both take O(log N) steps
+class BuddyAllocator {
+public:
+    // poolSize and minBlockSize must be powers of two
+    BuddyAllocator(mem_size_t base, mem_size_t poolSize, mem_size_t minBlockSize);
+
+    // Allocate a block for allocation ID id, false if no block is large enough
+    bool allocate(alloc_id_t id, mem_size_t req_size);
+
+    // Free the block of allocation ID id, false if id is not allocated here
+    bool release(alloc_id_t id);
+
+    // Requested size of allocation ID id, false if id is not allocated here
+    bool requestedSize(alloc_id_t id, mem_size_t &size) const;
+
+    // Change the requested size of id in place, false if newSize does not fit its block
+    bool resize(alloc_id_t id, mem_size_t newSize);
+
+    // Give the allocation `from` the ID `to`, false if from is not allocated here
+    bool rename(alloc_id_t from, alloc_id_t to);
+
+    mem_size_t getBase() const;
+    mem_size_t getPoolSize() const;
+    mem_size_t usedBytes() const;               // sum of the power-of-two blocks handed out
+    mem_size_t requestedBytes() const;          // sum of the sizes actually requested
+    mem_size_t internalFragmentation() const;   // usedBytes - requestedBytes
+    mem_size_t largestFreeBlock() const;
+    int freeBlockCount() const;
+
+    // Move the pool to newBase, appending the new address of every live block to relocations
+    void moveTo(mem_size_t newBase, std::vector<Relocation> &relocations);
+
+    // Add the free blocks of each order to histogram[order]
+    void addToHistogram(std::vector<int> &histogram) const;
+
+    // Print the blocks of the pool in address order
+    void dump() const;
+
+    // Copy the free lists with their remaining stale entries, the bitmaps and the allocations,
+    // so a restored pool hands out the same blocks as the original would
+    void save(SnapshotWriter &out) const;
+    bool load(SnapshotReader &in);
+
+private:
+    struct Allocation {
+        alloc_id_t id;      // allocation ID, -1 once released
+        mem_size_t offset;  // offset from base
+        int order;          // block size is 2^order
+        mem_size_t size;    // requested size
+    };
+
+    mem_size_t base;
+    int minOrder;
+    int maxOrder;
+
+    // Per-order stacks of free block offsets
+    // Merging leaves the buddy's entry behind; it is skipped when popped because its bit is clear,
+    // and dropped when the list is compacted
+    std::vector<std::vector<mem_size_t>> freeLists;
+
+    // Per-order bitmap, bit (offset >> order) is set while that block is free
+    std::vector<std::vector<uint64_t>> freeBits;
+    std::vector<int> freeCount;         // exact number of free blocks per order
+
+    std::vector<Allocation> allocations;
+    std::vector<uint32_t> freeSlots;    // recycled entries of allocations
+    IdTable idToAllocation;
+
+    mem_size_t used;
+    mem_size_t requested;
+
+    bool isFree(int order, mem_size_t offset) const;
+    void pushFree(int order, mem_size_t offset);
+    void removeFree(int order, mem_size_t offset);
+    void compactFree(int order);
+    mem_size_t popFree(int order);      // -1 if the order has no free block
+};
+
+#endif
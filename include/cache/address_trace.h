@@ -0,0 +1,102 @@
+// Defines the reader and writer for memory address traces driving the cache simulator
+
+#ifndef ADDRESS_TRACE_H
+#define ADDRESS_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "cache_simulator.h"
+
+// Binary address traces start with one of these 8 bytes, followed by one record per access
+//   fixed: 8-byte little-endian records, the address in bits 0-61 and the AccessType in bits 62-63
+//   delta: one LEB128 varint per record, the AccessType in bits 0-1 and above them the zigzag encoded
+//          difference to the previous address (the first record's to 0), taken modulo 2^62
+extern const char ADDRESS_TRACE_FIXED_MAGIC[8];
+extern const char ADDRESS_TRACE_DELTA_MAGIC[8];
+
+enum AddressTraceFormat {
+    ADDRESS_TEXT,       // one access per line, hex address or Valgrind lackey
+    ADDRESS_FIXED,
+    ADDRESS_DELTA
+};
+
+struct AddressAccess {
+    uint64_t address;
+    uint32_t size;      // bytes touched from address, 0 for a single address (binary records)
+    AccessType type;
+};
+
+// Parses an address trace, detecting the format from its first bytes
+// Text traces hold one access per line, either
+//   a hex address, with or without 0x, read as a READ
+//   a Valgrind lackey record "I|L|S|M addr,size", where I is an instruction fetch and M (modify) a read then a write
+// Blank lines and lines starting with '#', '=' or '-' (Valgrind's own messages) are skipped
+// Regular files are memory-mapped and parsed in place; pipes and stdin are streamed through a fixed buffer,
+// so a trace of any length is read in constant memory
+class AddressTraceReader {
+public:
+    AddressTraceReader();
+    ~AddressTraceReader();
+
+    // Open path, or stdin if path is "-"
+    // Returns false and sets error() if the input cannot be read
+    bool open(const char *path);
+
+    AddressTraceFormat getFormat() const;
+
+    // Parse up to count accesses into records; M records count as two
+    // Returns the number parsed, 0 at the end of the trace or on a parse error
+    size_t read(AddressAccess *records, size_t count);
+
+    bool failed() const;
+    const std::string &error() const;
+
+private:
+    int fd;                         // streamed input, -1 once it is exhausted or if the file is mapped
+    const char *data;
+    const char *pos;
+    const char *end;
+    size_t mappedLength;
+    std::vector<char> buffer;       // window of a streamed input
+    AddressTraceFormat format;
+    uint64_t previous;              // last address of a delta trace
+    int64_t line;                   // line of a text trace, record of a binary one
+    std::string errorMessage;
+
+    bool fill(size_t needed);
+    bool fail(const std::string &message);
+
+    bool nextLine(const char *&start, const char *&stop);
+    int parseLine(const char *start, const char *stop, AddressAccess *records);
+    bool nextFixed(AddressAccess &record);
+    bool nextDelta(AddressAccess &record);
+};
+
+// Writes binary address traces through a large output buffer
+class AddressTraceWriter {
+public:
+    AddressTraceWriter();
+    ~AddressTraceWriter();
+
+    // Write format (ADDRESS_FIXED or ADDRESS_DELTA) to path, or to stdout if path is "-"
+    bool open(const char *path, AddressTraceFormat format);
+
+    void write(uint64_t address, AccessType type);
+
+    // Flush and close, false if any write failed
+    bool close();
+
+private:
+    FILE *file;
+    AddressTraceFormat format;
+    bool ok;
+    uint64_t previous;
+    std::vector<char> buffer;
+
+    void flush();
+};
+
+#endif
@@ -1,16 +1,45 @@
 #ifndef CACHE_LEVEL_H
 #define CACHE_LEVEL_H
 
+#include <cstddef>
+#include <cstdint>
+#include <variant>
 #include <vector>
-#include <deque>
+#include "replacement_policy.h"
+#include "tag_lookup.h"
 
-// Replacement policy type
+// Replacement policy type, picks the policy class a level is built with
 enum ReplacementPolicy {
     FIFO,
-    LRU
+    LRU,
+    TREE_PLRU,
+    SRRIP,
+    BRRIP,
+    LFU,
+    RANDOM
 };
 
-// Represents one cache level (L1 or L2)
+// How a level relates to the level directly above it in the hierarchy, ignored for L1
+//   INCLUSIVE  holds every block of the level above; its evictions back-invalidate that level
+//   EXCLUSIVE  holds no block of the level above; it is filled only by that level's evictions, and a hit moves the block up
+//   NINE       neither: filled on misses like INCLUSIVE, but never back-invalidates
+enum InclusionPolicy {
+    INCLUSIVE,
+    EXCLUSIVE,
+    NINE
+};
+
+// How a level handles stores
+//   WRITE_BACK     write-allocate: a store miss fetches the block, stores mark the line dirty,
+//                  and dirty lines are written to the level below when they leave
+//   WRITE_THROUGH  no-write-allocate: lines are never dirty, every store is passed on to the level below
+//                  and a store miss does not fetch the block
+enum WritePolicy {
+    WRITE_BACK,
+    WRITE_THROUGH
+};
+
+// Represents one level of the cache hierarchy
 class CacheLevel
 {
 private:
@@ -19,30 +48,105 @@ private:
     int associativity;
     int numSets;
 
+    // Power-of-two geometries split addresses with shifts and masks instead of divisions, -1 otherwise
+    int blockShift;     // address >> blockShift is the block address
+    int setMask;        // block_address & setMask is the set
+
     ReplacementPolicy policy;
+    InclusionPolicy inclusion;
+    WritePolicy writePolicy;
+
+    // All sets in one array of numSets * associativity lines, set s owning lines [s*associativity, (s+1)*associativity)
+    // Each line holds the block address it caches, EMPTY_LINE if it is unused: its low 32 bits in tags,
+    // which the lookup kernels compare a whole set of at once, and its high 32 bits in highTags,
+    // checked only for a way whose low bits match
+    // Only lines with LINE_VALID cache a block, so a block whose address equals EMPTY_LINE is not mistaken for an unused line
+    std::vector<int> tags;
+    std::vector<uint32_t> highTags;
+    std::vector<uint8_t> lineFlags;     // per line, LINE_VALID and LINE_DIRTY
+
+    static const uint8_t LINE_VALID=1;  // the line caches a block
+    static const uint8_t LINE_DIRTY=2;  // the line holds data not yet written to the level below
+
+    // Compares a whole set against a tag, the widest SIMD kernel the CPU supports
+    TagLookup findTag;
+
+    // Metadata of the level's replacement policy, one of the classes in replacement_policy.h
+    // Each public operation dispatches on it once, and the policy's updates are then inlined into a
+    // copy of the operation compiled for that policy
+    std::variant<FifoPolicy, LruPolicy, TreePlruPolicy, SrripPolicy, BrripPolicy, LfuPolicy, RandomPolicy> replacement;
+    std::vector<int> occupied;      // lines in use per set
+
+    int64_t hits;
+    int64_t misses;
 
-    // Each set is a list of cache lines
-    std::vector<std::deque<int>> sets;
+    int setOf(uint64_t block_address) const
+    {
+        return setMask>=0 ? (int)(block_address & setMask) : (int)(block_address % numSets);
+    }
 
-    int hits;
-    int misses;
+    // Way of the set holding block_address, -1 if it is not cached; with valid false, the first unused way instead
+    // Ways whose low bits match but whose high bits or valid flag differ are skipped and the search goes on after them
+    int find(int set_number, uint64_t block_address, bool valid=true) const
+    {
+        size_t first=(size_t)set_number*associativity;
+        const int *set=tags.data()+first;
+        int low_tag=(int)(uint32_t)block_address;
+        uint32_t high_tag=block_address>>32;
+        for(int from=0 ; ; )
+        {
+            int way=findTag(set+from, associativity-from, low_tag);
+            if(way==-1)
+                return -1;
+            way+=from;
+            if(highTags[first+way]==high_tag && ((lineFlags[first+way]&LINE_VALID)!=0)==valid)
+                return way;
+            from=way+1;
+        }
+    }
+
+    template<class Policy> bool accessWith(Policy &policy, uint64_t block_address);
+    template<class Policy> bool insertWith(Policy &policy, uint64_t block_address, uint64_t *evicted_address, bool *evicted_dirty);
+    template<class Policy> bool removeWith(Policy &policy, uint64_t block_address);
 
 public:
+    static constexpr uint64_t EMPTY_LINE=~(uint64_t)0;
+
     CacheLevel(int cacheSize,
                int blockSize,
                int associativity,
-               ReplacementPolicy policy);
+               ReplacementPolicy policy,
+               InclusionPolicy inclusion=EXCLUSIVE,
+               WritePolicy writePolicy=WRITE_BACK);
 
     // Returns true if hit, false if miss
-    bool access(int block_address);
-    int insert(int block_address);
-    void remove(int block_address);
-    
-    int getHits() const;
-    int getMisses() const;
+    bool access(uint64_t block_address);
+
+    // Returns true if a block was evicted to make room, with its address and whether it was dirty
+    bool insert(uint64_t block_address, uint64_t *evicted_address=nullptr, bool *evicted_dirty=nullptr);
+
+    // Returns true if the removed line was dirty
+    bool remove(uint64_t block_address);
+
+    // Mark the line holding block_address dirty, if it is cached
+    void markDirty(uint64_t block_address);
+
+    // True if the block is cached, without counting a hit or miss or updating the policy
+    bool contains(uint64_t block_address) const;
+
+    int64_t getHits() const;
+    int64_t getMisses() const;
     int getBlockSize() const;
+    InclusionPolicy getInclusion() const;
+    WritePolicy getWritePolicy() const;
+
+    // Block address containing a byte address
+    uint64_t blockOf(uint64_t address) const
+    {
+        return blockShift>=0 ? address>>blockShift : address/blockSize;
+    }
+
 
-    
     void resetStats();
 };
 
@@ -1,22 +1,53 @@
 #ifndef CACHE_SIMULATOR_H
 #define CACHE_SIMULATOR_H
 
+#include <cstdint>
+#include <vector>
 #include "cache_level.h"
 
+// Kind of memory access; instruction fetches are simulated as reads
+enum AccessType {
+    READ,
+    WRITE,
+    INSTRUCTION_FETCH
+};
+
+// A hierarchy of cache levels, L1 first
+// Each level's inclusion policy decides how blocks move between it and the level above it
 class CacheSimulator
 {
 private:
-    CacheLevel L1;
-    CacheLevel L2;
+    std::vector<CacheLevel> levels;
+
+    int64_t memoryAccesses;
+    int64_t writeAccesses;
+
+    // Write traffic per boundary, entry i counting transfers from level i to level i + 1 (or memory)
+    std::vector<int64_t> writebacks;        // dirty lines leaving a write-back level
+    std::vector<int64_t> writeThroughs;     // stores passed on by write-through levels or levels that missed
+
+    // Place the block holding address in a level, handling whatever it evicts
+    void fill(int level, uint64_t address);
+    void evict(int level, uint64_t block_address, bool dirty);
+
+    // Remove every block of a level overlapping [start, start + length) and, through inclusive levels, above it
+    // Returns true if any removed block was dirty
+    bool invalidate(int level, uint64_t start, uint64_t length);
+
+    // Hand data leaving a level to the levels below until a write-back level holding the block absorbs it
+    void writeDown(int level, uint64_t address, std::vector<int64_t> &traffic);
 
-    int memoryAccesses;
+    // A dirty block moved up into level: mark it dirty there, or write it down if the level is write-through
+    void keepDirty(int level, uint64_t address);
 
 public:
+    // Two-level hierarchy, exclusive unless L2 was built with another inclusion policy
     CacheSimulator(CacheLevel l1, CacheLevel l2);
+    CacheSimulator(std::vector<CacheLevel> levels);
 
-    void access(int address);
+    void access(uint64_t address, AccessType type=READ);
     void printStats() const;
     void resetStats();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,265 @@
+// Defines the replacement policy classes CacheLevel is specialized on
+
+#ifndef REPLACEMENT_POLICY_H
+#define REPLACEMENT_POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Every policy keeps its own metadata for numSets sets of `ways` lines and implements
+//   hit(set, way)      the line was accessed
+//   insert(set, way)   a block was placed in the empty line
+//   remove(set, way)   the line was emptied
+//   victim(set)        the line to replace in a full set; the caller removes it and inserts the new block there
+// The methods are defined in the class so CacheLevel inlines them into its per-policy access paths
+
+
+// FIFO and LRU: the lines of a set form a queue from the front (evicted next) to the back
+// A block joins the back when it is inserted; LRU also moves a line to the back whenever it hits
+// The queue is linked through per-line metadata, so no operation searches or shifts the set
+template<bool moveOnHit>
+class QueuePolicy
+{
+private:
+    struct LineLinks {
+        int older;      // way in front of this line, -1 at the front
+        int newer;      // way behind this line, -1 at the back
+    };
+    struct SetQueue {
+        int front;
+        int back;
+    };
+
+    int ways;
+    std::vector<LineLinks> links;
+    std::vector<SetQueue> queues;
+
+public:
+    QueuePolicy(int numSets=0, int ways=0)
+        : ways(ways), links((size_t)numSets*ways, LineLinks{-1, -1}), queues(numSets, SetQueue{-1, -1}) {}
+
+    void hit(int set, int way)
+    {
+        if(moveOnHit)
+        {
+            remove(set, way);
+            insert(set, way);
+        }
+    }
+
+    void insert(int set, int way)
+    {
+        LineLinks *line=&links[(size_t)set*ways];
+        SetQueue &queue=queues[set];
+
+        line[way].older=queue.back;
+        line[way].newer=-1;
+        if(queue.back!=-1)
+            line[queue.back].newer=way;
+        else
+            queue.front=way;
+        queue.back=way;
+    }
+
+    void remove(int set, int way)
+    {
+        LineLinks *line=&links[(size_t)set*ways];
+        SetQueue &queue=queues[set];
+
+        if(line[way].older!=-1)
+            line[line[way].older].newer=line[way].newer;
+        else
+            queue.front=line[way].newer;
+
+        if(line[way].newer!=-1)
+            line[line[way].newer].older=line[way].older;
+        else
+            queue.back=line[way].older;
+    }
+
+    int victim(int set) const
+    {
+        return queues[set].front;
+    }
+};
+
+typedef QueuePolicy<false> FifoPolicy;
+typedef QueuePolicy<true> LruPolicy;
+
+
+// Tree pseudo-LRU: a binary tree of one-bit nodes per set, each pointing to the half holding the older lines
+// An access flips the nodes on its path to point away from it, the victim is found by following the nodes
+// Associativities that are not a power of two get the next larger tree, whose missing leaves are never chosen
+class TreePlruPolicy
+{
+private:
+    int ways;
+    int levels;         // tree depth, log2 of the leaves
+    std::vector<uint8_t> nodes;     // (1 << levels) - 1 per set, in heap order
+
+public:
+    TreePlruPolicy(int numSets=0, int ways=0) : ways(ways), levels(0)
+    {
+        while((1<<levels)<ways)
+            levels++;
+        nodes.assign((size_t)numSets*((1<<levels)-1), 0);
+    }
+
+    void hit(int set, int way)
+    {
+        uint8_t *tree=nodes.data()+(size_t)set*((1<<levels)-1);
+        int node=0;
+        for(int level=levels-1 ; level>=0 ; level--)
+        {
+            int right=(way>>level)&1;
+            tree[node]=!right;
+            node=2*node+1+right;
+        }
+    }
+
+    void insert(int set, int way)
+    {
+        hit(set, way);
+    }
+
+    void remove(int, int) {}
+
+    int victim(int set) const
+    {
+        const uint8_t *tree=nodes.data()+(size_t)set*((1<<levels)-1);
+        int node=0;
+        int way=0;
+        for(int level=levels-1 ; level>=0 ; level--)
+        {
+            int right=tree[node] & (((way<<1|1)<<level)<ways);      // never into a half without real ways
+            way=way<<1|right;
+            node=2*node+1+right;
+        }
+        return way;
+    }
+};
+
+
+// Static and bimodal re-reference interval prediction with 2-bit re-reference values per line
+// Hits predict a near re-reference (0). SRRIP inserts with a long prediction (2);
+// BRRIP inserts with a distant one (3) except for one insertion in BRRIP_LONG_EVERY, which makes it scan resistant
+// The victim is the first line predicted distant, after ageing the whole set until one is
+template<bool bimodal>
+class RripPolicy
+{
+private:
+    static constexpr uint8_t DISTANT=3;
+    static constexpr int BRRIP_LONG_EVERY=32;
+
+    int ways;
+    std::vector<uint8_t> rrpv;
+    int inserts;        // BRRIP throttle, counts insertions level-wide
+
+public:
+    RripPolicy(int numSets=0, int ways=0) : ways(ways), rrpv((size_t)numSets*ways, DISTANT), inserts(0) {}
+
+    void hit(int set, int way)
+    {
+        rrpv[(size_t)set*ways+way]=0;
+    }
+
+    void insert(int set, int way)
+    {
+        uint8_t prediction=DISTANT-1;
+        if(bimodal)
+        {
+            prediction=DISTANT-(inserts==0);
+            inserts=inserts+1==BRRIP_LONG_EVERY ? 0 : inserts+1;
+        }
+        rrpv[(size_t)set*ways+way]=prediction;
+    }
+
+    void remove(int, int) {}
+
+    int victim(int set)
+    {
+        uint8_t *line=&rrpv[(size_t)set*ways];
+        uint8_t oldest=0;
+        for(int way=0 ; way<ways ; way++)
+            oldest=line[way]>oldest ? line[way] : oldest;
+
+        uint8_t age=DISTANT-oldest;
+        int victim=-1;
+        for(int way=ways-1 ; way>=0 ; way--)
+        {
+            line[way]+=age;
+            victim=line[way]==DISTANT ? way : victim;
+        }
+        return victim;
+    }
+};
+
+typedef RripPolicy<false> SrripPolicy;
+typedef RripPolicy<true> BrripPolicy;
+
+
+// Least frequently used: a saturating hit count per line, starting at 1 when the block is inserted
+// The victim is the line with the lowest count, the lowest way among equal counts
+class LfuPolicy
+{
+private:
+    int ways;
+    std::vector<uint32_t> counts;
+
+public:
+    LfuPolicy(int numSets=0, int ways=0) : ways(ways), counts((size_t)numSets*ways, 0) {}
+
+    void hit(int set, int way)
+    {
+        uint32_t &count=counts[(size_t)set*ways+way];
+        count+=count!=UINT32_MAX;
+    }
+
+    void insert(int set, int way)
+    {
+        counts[(size_t)set*ways+way]=1;
+    }
+
+    void remove(int, int) {}
+
+    int victim(int set) const
+    {
+        const uint32_t *line=&counts[(size_t)set*ways];
+        int victim=0;
+        uint32_t lowest=line[0];
+        for(int way=1 ; way<ways ; way++)
+        {
+            bool lower=line[way]<lowest;
+            victim=lower ? way : victim;
+            lowest=lower ? line[way] : lowest;
+        }
+        return victim;
+    }
+};
+
+
+// Uniformly random victim from a fixed-seed xorshift64* generator, so runs are reproducible
+class RandomPolicy
+{
+private:
+    int ways;
+    uint64_t state;
+
+public:
+    RandomPolicy(int=0, int ways=0) : ways(ways), state(0x9E3779B97F4A7C15ULL) {}
+
+    void hit(int, int) {}
+    void insert(int, int) {}
+    void remove(int, int) {}
+
+    int victim(int)
+    {
+        state^=state>>12;
+        state^=state<<25;
+        state^=state>>27;
+        return (int)(((unsigned __int128)(state*0x2545F4914F6CDD1DULL)*ways)>>64);
+    }
+};
+
+#endif
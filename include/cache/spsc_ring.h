@@ -0,0 +1,90 @@
+// Defines the bounded single-producer single-consumer ring that hands work between two threads
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// A fixed number of slots allocated up front, filled in place by one producer thread and drained in order by one consumer
+// The producer waits while every slot is in use, the consumer while none is published, so memory stays bounded
+// head and tail are each written by one side only and sit on their own cache lines
+template<class T>
+class SpscRing
+{
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head;       // slots published, written by the producer
+    alignas(64) std::atomic<size_t> tail;       // slots released, written by the consumer
+    alignas(64) std::atomic<bool> closed;
+
+    // Slots hold whole batches, so waits are long compared to a spin: yield first, then sleep
+    static void pause(int &waits)
+    {
+        if(++waits<100)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) : head(0), tail(0), closed(false)
+    {
+        size_t size=1;
+        while(size<capacity)
+            size<<=1;
+        slots.resize(size);
+        mask=size-1;
+    }
+
+    // Producer: the next slot to fill, once the consumer has released it
+    T &acquire()
+    {
+        size_t next=head.load(std::memory_order_relaxed);
+        int waits=0;
+        while(next-tail.load(std::memory_order_acquire)>mask)
+            pause(waits);
+        return slots[next&mask];
+    }
+
+    // Producer: hand the acquired slot to the consumer
+    void publish()
+    {
+        head.store(head.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+
+    // Producer: nothing more will be published
+    void close()
+    {
+        closed.store(true, std::memory_order_release);
+    }
+
+    // Consumer: the oldest published slot, nullptr once the ring is closed and drained
+    T *front()
+    {
+        size_t next=tail.load(std::memory_order_relaxed);
+        int waits=0;
+        while(true)
+        {
+            if(head.load(std::memory_order_acquire)!=next)
+                return &slots[next&mask];
+            if(closed.load(std::memory_order_acquire))
+                return head.load(std::memory_order_acquire)!=next ? &slots[next&mask] : nullptr;
+            pause(waits);
+        }
+    }
+
+    // Consumer: give the slot returned by front() back to the producer
+    void release()
+    {
+        tail.store(tail.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+};
+
+#endif
@@ -0,0 +1,32 @@
+// Defines the way-parallel tag comparison kernels used by CacheLevel
+
+#ifndef TAG_LOOKUP_H
+#define TAG_LOOKUP_H
+
+#include <vector>
+
+// SSE2 and AVX2 kernels are built on x86 with GCC or Clang, build with -DCACHE_SCALAR_LOOKUP to leave them out
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && defined(__SSE2__) && !defined(CACHE_SCALAR_LOOKUP)
+#define TAG_LOOKUP_X86 1
+#endif
+
+// Returns the first of the `ways` tags equal to tag, -1 if none is
+typedef int (*TagLookup)(const int *tags, int ways, int tag);
+
+int findTagScalar(const int *tags, int ways, int tag);
+
+#ifdef TAG_LOOKUP_X86
+// Compare 4 (SSE2) or 8 (AVX2) 32-bit tags per instruction and take the hit way from the movemask
+int findTagSse2(const int *tags, int ways, int tag);
+int findTagAvx2(const int *tags, int ways, int tag);
+#endif
+
+// Fastest kernel the running CPU supports, detected on the first call
+TagLookup bestTagLookup();
+
+// Every kernel the running CPU supports, scalar first
+std::vector<TagLookup> supportedTagLookups();
+
+const char *tagLookupName(TagLookup lookup);
+
+#endif
@@ -0,0 +1,62 @@
+// Defines the fragmentation time-series sampler
+
+#ifndef FRAGMENTATION_SAMPLER_H
+#define FRAGMENTATION_SAMPLER_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "allocator.h"
+
+// One point of the time series, all fields 64-bit so the binary dump has no padding
+struct FragmentationSample {
+    int64_t operation;              // operations replayed when the sample was taken
+    int64_t failure;                // 1 if taken because the operation failed, 0 for an interval sample
+    mem_size_t totalSize;
+    mem_size_t usedBytes;
+    mem_size_t freeBytes;
+    mem_size_t largestFreeBlock;
+    int64_t freeBlocks;
+};
+
+// Binary sample dumps start with these 8 bytes, then a 64-bit sample count and the raw samples
+extern const char SAMPLE_MAGIC[8];
+
+// Records allocator statistics every `interval` operations and after every failed operation
+// Samples go into a ring buffer allocated up front; once it is full the oldest samples are overwritten,
+// so a replay of any length keeps the latest `capacity` samples and never allocates
+// Utilization and external fragmentation are derived when the samples are written, not when they are taken
+class FragmentationSampler {
+public:
+    // interval 0 records failures only
+    FragmentationSampler(size_t capacity, int64_t interval);
+
+    // Call once after every operation, inline so the common case is a decrement and a branch
+    void record(const Allocator &allocator, bool failed)
+    {
+        operations++;
+        if(--countdown==0 || failed)
+            take(allocator, failed);
+    }
+
+    size_t size() const;
+    int64_t dropped() const;        // samples overwritten because the buffer was full
+
+    // Samples oldest first, one CSV row each with a header line
+    void writeCsv(std::ostream &out) const;
+    void writeBinary(std::ostream &out) const;
+
+private:
+    std::vector<FragmentationSample> ring;
+    size_t next;                    // slot the next sample goes to
+    size_t count;
+    int64_t interval;
+    int64_t countdown;              // operations until the next interval sample
+    int64_t operations;
+    int64_t overwritten;
+
+    void take(const Allocator &allocator, bool failed);
+    const FragmentationSample &at(size_t i) const;     // i-th oldest sample
+};
+
+#endif
@@ -0,0 +1,105 @@
+// Defines the indexes of free blocks used by the allocation strategies
+
+#ifndef FREE_TREE_H
+#define FREE_TREE_H
+
+#include <cstdint>
+#include <vector>
+#include "block.h"
+#include "snapshot.h"
+
+// Treap of free blocks keyed on start address
+// Every node also stores the largest free size in its subtree,
+// so the lowest-addressed block that fits is found by descending from the root in O(log n)
+class FreeTree {
+public:
+    typedef uint32_t Handle;    // arena index of the block
+
+    FreeTree();
+
+    void insert(mem_size_t start, mem_size_t size, Handle handle);
+    void erase(mem_size_t start);
+
+    // Replace the entry at old_start in place
+    // new_start must keep the same address order relative to the other entries
+    void replace(mem_size_t old_start, mem_size_t new_start, mem_size_t new_size, Handle handle);
+
+    bool empty() const;
+    uint32_t size() const { return (uint32_t)(nodes.size()-freeSlots.size()); }
+    mem_size_t maxSize() const;        // largest free block, 0 if empty
+
+    // Lowest-addressed free block with start >= from and size >= req_size
+    // Returns false if there is none
+    bool findFirst(mem_size_t from, mem_size_t req_size, Handle &out) const;
+
+    // Copy the node pool, root and priority seed, a restored tree has the same shape
+    // load rejects links that leave the pool or form a cycle, and handles >= handles
+    void save(SnapshotWriter &out) const;
+    bool load(SnapshotReader &in, uint32_t handles);
+
+private:
+    struct Node {
+        mem_size_t start;
+        mem_size_t size;
+        mem_size_t maxSize;            // largest size in this subtree
+        unsigned priority;
+        int left;
+        int right;
+        Handle handle;
+    };
+
+    std::vector<Node> nodes;    // node pool, links are indices into it
+    std::vector<int> freeSlots; // recycled node indices
+    int root;
+    unsigned seed;
+
+    int newNode(mem_size_t start, mem_size_t size, Handle handle);
+    void update(int n);
+    void split(int n, mem_size_t key, int &left, int &right);   // left: start < key, right: start >= key
+    int merge(int left, int right);
+    void replace(int n, mem_size_t old_start, mem_size_t new_start, mem_size_t new_size, Handle handle);
+    int findFirstNode(int n, mem_size_t from, mem_size_t req_size) const;
+};
+
+// Treap of free blocks keyed on (size, start), used by best fit
+class SizeTree {
+public:
+    typedef uint32_t Handle;
+
+    SizeTree();
+
+    void insert(mem_size_t size, mem_size_t start, Handle handle);
+    void erase(mem_size_t size, mem_size_t start);
+
+    // Smallest free block with size >= req_size, lowest address on ties
+    // Returns false if there is none
+    bool lowerBound(mem_size_t req_size, Handle &out) const;
+
+    uint32_t size() const { return (uint32_t)(nodes.size()-freeSlots.size()); }
+
+    // Same as FreeTree::save and FreeTree::load
+    void save(SnapshotWriter &out) const;
+    bool load(SnapshotReader &in, uint32_t handles);
+
+private:
+    struct Node {
+        mem_size_t size;
+        mem_size_t start;
+        unsigned priority;
+        int left;
+        int right;
+        Handle handle;
+    };
+
+    std::vector<Node> nodes;    // node pool, links are indices into it
+    std::vector<int> freeSlots; // recycled node indices
+    int root;
+    unsigned seed;
+
+    int newNode(mem_size_t size, mem_size_t start, Handle handle);
+    bool less(int n, mem_size_t size, mem_size_t start) const;
+    void split(int n, mem_size_t size, mem_size_t start, int &left, int &right);   // left: (size, start) < key
+    int merge(int left, int right);
+};
+
+#endif
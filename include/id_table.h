@@ -0,0 +1,45 @@
+// Defines the map from allocation ID to block
+
+#ifndef ID_TABLE_H
+#define ID_TABLE_H
+
+#include <cstdint>
+#include <vector>
+#include "block.h"
+#include "snapshot.h"
+
+// Open-addressing hash table from allocation ID to arena index
+// Linear probing with backward-shift deletion, so erasing leaves no tombstones
+// and the table only allocates when it doubles
+class IdTable {
+public:
+    IdTable();
+
+    void insert(alloc_id_t id, uint32_t slot);
+    bool find(alloc_id_t id, uint32_t &slot) const;
+    bool erase(alloc_id_t id);  // false if id is not present
+
+    uint32_t size() const { return count; }
+    void clear();
+
+    // Copy the table as it is, a restore does not rehash
+    // load rejects a table that is not a power of two in size, more than half full, or has a slot >= slots
+    void save(SnapshotWriter &out) const;
+    bool load(SnapshotReader &in, uint32_t slots);
+
+private:
+    struct Entry {
+        alloc_id_t id;          // EMPTY if unused
+        uint32_t slot;
+    };
+    static constexpr alloc_id_t EMPTY=-1;  // allocation IDs are always positive
+
+    std::vector<Entry> table;
+    uint32_t mask;              // capacity - 1, capacity is a power of two
+    uint32_t count;
+
+    uint32_t home(alloc_id_t id) const;
+    void grow();
+};
+
+#endif
@@ -0,0 +1,108 @@
+// Defines the segregated size-class (slab) front end
+
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "block.h"
+#include "snapshot.h"
+#include "id_table.h"
+
+// Serves small requests from slabs, fixed-size blocks that are split into equal objects of one size class
+// Slabs themselves are blocks of the Allocator's address space; the Allocator carves and frees them
+// Allocation and free are O(1): every class keeps a list of slabs with free objects,
+// and every slab keeps a stack of its free objects
+class SlabAllocator {
+public:
+    static constexpr uint32_t NONE=0xFFFFFFFFu;
+
+    // classSizes must be sorted and each no larger than slabSize
+    SlabAllocator(const std::vector<int> &classSizes, int slabSize);
+
+    int getSlabSize() const;
+    int largestClass() const;
+
+    // Index of the smallest class that fits req_size
+    int classFor(int req_size) const;
+
+    // True if class c has a slab with a free object
+    bool hasFreeObject(int c) const;
+
+    // Register a newly carved slab for class c, handle is the Allocator's block index
+    void addSlab(int c, mem_size_t start, uint32_t handle);
+
+    // Allocate an object of class c for allocation ID id, class c must have a free object
+    void allocate(alloc_id_t id, int c, int req_size);
+
+    // Free the object of allocation ID id, false if id is not allocated here
+    // If its slab is no longer needed, releasedHandle is set to the slab's block index, otherwise to NONE
+    bool release(alloc_id_t id, uint32_t &releasedHandle);
+
+    // Requested size of allocation ID id, false if id is not allocated here
+    bool requestedSize(alloc_id_t id, mem_size_t &size) const;
+
+    // Change the requested size of id in place, false if newSize does not fit its class
+    bool resize(alloc_id_t id, mem_size_t newSize);
+
+    // Give the allocation `from` the ID `to`, false if from is not allocated here
+    bool rename(alloc_id_t from, alloc_id_t to);
+
+    // Move the slab in block `handle` to newStart, appending the new address of every live object to relocations
+    void moveSlab(uint32_t handle, mem_size_t newStart, std::vector<Relocation> &relocations);
+
+    // Look up the slab that lives in block `handle`, false if it is not a slab
+    bool slabInfo(uint32_t handle, int &classSize, int &used, int &capacity) const;
+
+    mem_size_t internalFragmentation() const;   // sum over classes
+    void printStats() const;
+
+    // Copy the classes, the slabs with their free-object stacks, and the allocations
+    // load rejects indices outside their arrays, slab handles >= handles, and object counts that do not add up
+    void save(SnapshotWriter &out) const;
+    bool load(SnapshotReader &in, uint32_t handles);
+
+private:
+    struct Slab {
+        mem_size_t start;
+        int classIndex;
+        int used;
+        uint32_t handle;            // Allocator block index
+        uint32_t prevPartial;       // links in the class's list of slabs with free objects
+        uint32_t nextPartial;
+        bool partial;
+        std::vector<int> freeObjects;   // indices of free objects
+        std::vector<alloc_id_t> objectIds;  // allocation ID of each object, -1 if free
+    };
+
+    struct SizeClass {
+        int size;
+        int capacity;               // objects per slab
+        uint32_t partialHead;
+        int slabs;
+        int emptySlabs;             // slabs with no used object, one is kept for reuse
+        int usedObjects;
+        long long requested;        // bytes actually requested by live objects
+    };
+
+    struct Allocation {
+        uint32_t slab;
+        int object;
+        int size;                   // requested size
+    };
+
+    int slabSize;
+    std::vector<SizeClass> classes;
+    std::vector<Slab> slabs;
+    std::vector<uint32_t> freeSlabSlots;
+    IdTable handleToSlab;           // Allocator block index -> slab, for dumps
+
+    std::vector<Allocation> allocations;
+    std::vector<uint32_t> freeAllocationSlots;
+    IdTable idToAllocation;
+
+    void linkPartial(uint32_t s);
+    void unlinkPartial(uint32_t s);
+};
+
+#endif
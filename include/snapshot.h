@@ -0,0 +1,91 @@
+// Defines the binary snapshot writer and reader used to checkpoint allocator state
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Snapshots start with these 8 bytes, the last one is the format version
+// The rest is the raw in-memory layout of each structure in native byte order, vectors as a 64-bit count followed by
+// their elements, so a snapshot can only be restored by a build with the same structure layout
+extern const char SNAPSHOT_MAGIC[8];
+
+// Appends values to a snapshot file through a large buffer
+class SnapshotWriter {
+public:
+    SnapshotWriter();
+    ~SnapshotWriter();
+
+    // Create path and write the magic
+    bool open(const char *path);
+
+    // Flush and close, false if any write failed
+    bool close();
+
+    void putBytes(const void *bytes, size_t length);
+
+    template<typename T> void put(const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as raw bytes");
+        putBytes(&value, sizeof(T));
+    }
+
+    template<typename T> void putVector(const std::vector<T> &values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as raw bytes");
+        put((uint64_t)values.size());
+        putBytes(values.data(), values.size()*sizeof(T));
+    }
+
+private:
+    FILE *file;
+    bool ok;
+    std::vector<char> buffer;
+
+    void flush();
+};
+
+// Reads a snapshot straight out of a memory-mapped file
+// Every read is bounds checked; vectors are filled with one copy from the mapping, nothing is parsed
+class SnapshotReader {
+public:
+    SnapshotReader();
+    ~SnapshotReader();
+
+    // Map path and check the magic
+    bool open(const char *path);
+
+    bool getBytes(void *bytes, size_t length);
+
+    template<typename T> bool get(T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as raw bytes");
+        return getBytes(&value, sizeof(T));
+    }
+
+    template<typename T> bool getVector(std::vector<T> &values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as raw bytes");
+        uint64_t count;
+        if(!get(count) || count>(uint64_t)(end-pos)/sizeof(T))
+            return false;
+        values.resize(count);
+        return getBytes(values.data(), count*sizeof(T));
+    }
+
+    // True once every byte has been read
+    bool atEnd() const;
+
+private:
+    const char *data;
+    const char *pos;
+    const char *end;
+    size_t mappedLength;
+};
+
+#endif
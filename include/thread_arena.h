@@ -0,0 +1,113 @@
+// Defines per-thread allocator arenas that refill from a shared chunk heap
+
+#ifndef THREAD_ARENA_H
+#define THREAD_ARENA_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "allocator.h"
+#include "id_table.h"
+
+// The global heap, cut into equal chunks that thread arenas take and give back
+// Fresh chunks come from an atomic bump index, returned chunks are recycled through a lock-free (Treiber) stack,
+// so a refill never takes a lock; every failed compare-and-swap is counted as contention
+class SharedHeap {
+public:
+    static constexpr uint32_t NONE=0xFFFFFFFFu;
+
+    SharedHeap(mem_size_t totalSize, mem_size_t chunkSize);
+
+    // Take a chunk, false if every chunk is in use
+    bool acquire(uint32_t &chunk);
+
+    // Give a chunk back, any thread can take it next
+    void release(uint32_t chunk);
+
+    mem_size_t getChunkSize() const;
+    uint32_t getChunkCount() const;
+    int64_t casRetries() const;
+    uint32_t chunksInUse() const;
+    uint32_t peakChunksInUse() const;
+
+private:
+    mem_size_t chunkSize;
+    uint32_t chunkCount;
+    std::atomic<uint32_t> bump;         // chunks below it have been handed out at least once
+    std::atomic<uint64_t> freeHead;     // top of the recycled stack, ABA tag in the high half and chunk in the low half
+    std::unique_ptr<std::atomic<uint32_t>[]> freeNext;     // stack link of each recycled chunk
+    std::atomic<int64_t> retries;
+    std::atomic<uint32_t> inUse;
+    std::atomic<uint32_t> peakInUse;
+
+    void taken();
+};
+
+// Counters of one arena, taken when its thread is done
+struct ArenaStats {
+    int64_t allocRequests;
+    int64_t allocFailures;
+    int64_t frees;
+    int64_t invalidFrees;
+    int64_t reallocs;
+    int64_t refills;                // chunks taken from the shared heap
+    int64_t chunksReturned;
+    int chunks;                     // chunks held now
+    int peakChunks;
+    mem_size_t usedBytes;
+    mem_size_t freeBytes;           // free bytes inside the chunks held
+    mem_size_t largestFreeBlock;
+};
+
+// Private heap of one simulated thread, only ever used by that thread
+// Each chunk it holds is managed by its own Allocator, allocation IDs are numbered per arena from 1
+// When no chunk fits a request the arena refills with a chunk from the SharedHeap,
+// and a chunk that becomes empty goes back unless it is the last one the arena holds
+class ThreadArena {
+public:
+    ThreadArena(SharedHeap &shared);
+
+    // Requests larger than a chunk fail
+    // alignment is a power of two for the address inside the chunk, 0 for none
+    alloc_id_t allocate(AllocationStrategy strategy, mem_size_t size, mem_size_t alignment=0);
+
+    bool freeBlock(alloc_id_t id);
+
+    // Resize inside the chunk if possible, otherwise move to another chunk, keeping the ID and the alignment
+    bool reallocate(alloc_id_t id, mem_size_t newSize, AllocationStrategy strategy);
+
+    ArenaStats getStats() const;
+
+private:
+    struct Chunk {
+        uint32_t index;                 // chunk of the shared heap
+        std::unique_ptr<Allocator> heap;    // null once the chunk is returned
+    };
+
+    struct Allocation {
+        uint32_t slot;                  // entry of chunks
+        uint8_t alignLog2;              // log2 of the requested alignment, 0 for none
+        alloc_id_t localId;             // ID inside that chunk's Allocator
+    };
+
+    SharedHeap &shared;
+    std::vector<Chunk> chunks;
+    std::vector<uint32_t> freeChunkSlots;
+    uint32_t current;                   // chunk that served the last allocation, tried first
+    int heldChunks;
+
+    std::vector<Allocation> allocations;
+    std::vector<uint32_t> freeAllocationSlots;
+    IdTable idToAllocation;
+    alloc_id_t nextId;
+
+    ArenaStats counters;
+
+    // Allocate size bytes in some chunk, refilling if none fits
+    bool place(AllocationStrategy strategy, mem_size_t size, mem_size_t alignment, uint32_t &slot, alloc_id_t &localId);
+
+    void returnIfEmpty(uint32_t slot);
+};
+
+#endif
@@ -0,0 +1,48 @@
+// Defines the two-level segregated fit (TLSF) index of free blocks
+
+#ifndef TLSF_INDEX_H
+#define TLSF_INDEX_H
+
+#include <cstdint>
+#include <vector>
+#include "block.h"
+#include "snapshot.h"
+
+// Free blocks are binned by size into FL_COUNT first-level ranges (powers of two),
+// each split linearly into SL_COUNT second-level ranges
+// One bitmap marks the first-level ranges that have free blocks, one bitmap per first level marks its non-empty bins,
+// so a lookup is a couple of bit scans and never depends on the number of free blocks
+class TlsfIndex {
+public:
+    static constexpr uint32_t NONE=0xFFFFFFFFu;
+    static constexpr int SL_BITS=4;
+    static constexpr int SL_COUNT=1<<SL_BITS;
+    static constexpr int FL_COUNT=64-SL_BITS+1;    // covers every positive 64-bit size
+
+    TlsfIndex();
+
+    void insert(uint32_t handle, mem_size_t size);
+    void erase(uint32_t handle, mem_size_t size);
+
+    // Head of the first non-empty bin whose smallest size is >= req_size
+    // Every block in that bin fits, returns false if there is none
+    bool find(mem_size_t req_size, uint32_t &out) const;
+
+    // Copy the bitmaps, bin heads and bin links
+    // load rejects bins that are not well-formed lists of handles below handles, and bitmaps that disagree with the bins
+    void save(SnapshotWriter &out) const;
+    bool load(SnapshotReader &in, uint32_t handles);
+
+private:
+    uint64_t flBitmap;
+    uint32_t slBitmap[FL_COUNT];
+    uint32_t heads[FL_COUNT][SL_COUNT];
+
+    // Per-block links of the bin lists, indexed by handle
+    std::vector<uint32_t> prevLink;
+    std::vector<uint32_t> nextLink;
+
+    static void mapping(mem_size_t size, int &fl, int &sl);
+};
+
+#endif
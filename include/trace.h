@@ -0,0 +1,143 @@
+// Defines the reader and writer for allocator trace files
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "allocator.h"
+
+// Trace commands, the same format the interactive CLI reads
+// Numbered as in binary traces, so new commands go at the end
+enum TraceOpType {
+    OP_MALLOC,          // malloc <strategy> <size>
+    OP_FREE,            // free <id>
+    OP_REALLOC,         // realloc <id> <size>
+    OP_SLAB,            // slab <slabSize> <classSize,classSize,...>
+    OP_COMPACT,
+    OP_AUTOCOMPACT,     // autocompact on|off
+    OP_DUMP,
+    OP_STATS,
+    OP_HISTOGRAM,
+    OP_EXIT,
+    OP_MEMALIGN,        // memalign <strategy> <size> <alignment>
+    OP_LAYOUT           // layout <header> <footer> <alignment>
+};
+
+// Binary traces start with these 8 bytes, followed by the memory size and one record per command
+// Each record is one byte with the command type in bits 0-3, the strategy in bits 4-6 (malloc, memalign and realloc only,
+// 0 otherwise) and a thread flag in bit 7,
+// then the thread (if flagged) and the command's numbers as LEB128 varints, signed ones zigzag encoded:
+//   malloc: size    free: id    realloc: id, size    slab: slab size, class count, classes    autocompact: 0 or 1
+//   memalign: size, alignment    layout: header, footer, alignment
+extern const char TRACE_MAGIC[8];
+
+struct TraceOp {
+    TraceOpType type;
+    int thread;                     // from the optional t<N> prefix, 0 without one
+    AllocationStrategy strategy;    // OP_MALLOC and OP_MEMALIGN, and OP_REALLOC where it is the strategy of the thread's last malloc
+    int64_t value;                  // size for OP_MALLOC and OP_MEMALIGN, id for OP_FREE and OP_REALLOC, slab size for OP_SLAB,
+                                    // 1 for autocompact on, header size for OP_LAYOUT
+    int64_t size;                   // new size for OP_REALLOC, footer size for OP_LAYOUT
+    int64_t alignment;              // OP_MEMALIGN and OP_LAYOUT
+};
+
+// Parses a trace straight out of a memory-mapped file, without copying lines or building strings
+// The first token of a text trace is the total memory size, followed by one command per line
+// A command may start with t<N> to give the simulated thread that issues it
+// Binary traces are recognised by TRACE_MAGIC and decoded from the same mapping
+class TraceReader {
+public:
+    static const int MAX_THREADS=4096;
+
+    TraceReader();
+    ~TraceReader();
+
+    // Map path, or read all of stdin if path is "-"
+    // Returns false and sets error() if the file cannot be read or has no memory size
+    bool open(const char *path);
+
+    int64_t getMemorySize() const;
+
+    // One more than the highest thread seen so far
+    int getThreadCount() const;
+
+    // Parse the next command, false at the end of the trace or on a parse error
+    // Every field the command does not use is reset to 0
+    bool next(TraceOp &op);
+
+    // Class sizes of the last OP_SLAB
+    const std::vector<int> &getSlabClasses() const;
+
+    bool failed() const;
+    const std::string &error() const;
+
+private:
+    const char *data;
+    const char *pos;
+    const char *end;
+    bool binary;
+    size_t mappedLength;            // 0 if data points into stdinBuffer
+    std::vector<char> stdinBuffer;
+
+    int64_t memorySize;
+    int threadCount;
+    std::vector<AllocationStrategy> lastStrategy;   // per thread, for OP_REALLOC
+    int line;
+    std::vector<int> slabClasses;
+    std::string errorMessage;
+
+    void skipSpace();
+    bool token(const char *&start, size_t &length);
+    bool number(int64_t &value);
+    bool fail(const std::string &message);
+
+    bool varint(uint64_t &value);
+    bool signedVarint(int64_t &value);
+    bool nextBinary(TraceOp &op);
+};
+
+// Writes traces in the text command format or the binary format, through a large output buffer
+class TraceWriter {
+public:
+    TraceWriter();
+    ~TraceWriter();
+
+    // Write to path, or to stdout if path is "-"
+    bool open(const char *path, bool binary);
+
+    void writeHeader(int64_t memorySize);
+
+    // slabClasses is only read for OP_SLAB
+    void write(const TraceOp &op, const std::vector<int> &slabClasses=std::vector<int>());
+
+    // Flush and close, false if any write failed
+    bool close();
+
+private:
+    FILE *file;
+    bool binary;
+    bool ok;
+    std::vector<char> buffer;
+
+    void flush();
+    void put(char c);
+    void putText(const char *text);
+    void putNumber(int64_t value);
+    void putVarint(uint64_t value);
+    void putSignedVarint(int64_t value);
+};
+
+// Map a strategy name as used by the malloc command, false if unknown
+bool parseStrategy(const char *name, size_t length, AllocationStrategy &strategy);
+
+// Map a comma separated list of strategy names, false if any is unknown or the list is empty
+bool parseStrategyList(const char *list, std::vector<AllocationStrategy> &strategies);
+
+// Name of a strategy as used by the malloc command
+const char *strategyName(AllocationStrategy strategy);
+
+#endif
@@ -0,0 +1,90 @@
+// Defines the synthetic allocation workload generator
+
+#ifndef TRACE_GENERATOR_H
+#define TRACE_GENERATOR_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+// How request sizes are drawn
+enum SizeModel {
+    SIZE_UNIFORM,       // uniform in [minSize, maxSize]
+    SIZE_POWER_LAW,     // density proportional to size^-alpha on [minSize, maxSize], small sizes dominate
+    SIZE_BIMODAL,       // smallSize with probability smallFraction, otherwise largeSize
+    SIZE_HISTOGRAM      // bucket picked by its count, size uniform inside the bucket
+};
+
+// Which live allocation a free releases
+enum LifetimeModel {
+    LIFETIME_LIFO,          // the most recent one, stack-like
+    LIFETIME_FIFO,          // the oldest one, queue-like
+    LIFETIME_RANDOM,        // any live one with equal probability
+    LIFETIME_LONG_LIVED     // random, except a fraction of allocations is never freed
+};
+
+struct SizeBucket {
+    int64_t low;
+    int64_t high;
+    int64_t count;
+};
+
+struct WorkloadConfig {
+    int64_t operations;
+    int64_t memorySize;             // written as the trace header
+    uint64_t seed;
+
+    SizeModel sizeModel;
+    int64_t minSize;
+    int64_t maxSize;
+    double alpha;
+    int64_t smallSize;
+    int64_t largeSize;
+    double smallFraction;
+    std::vector<SizeBucket> buckets;
+
+    LifetimeModel lifetimeModel;
+    double longLivedFraction;
+
+    int64_t liveTarget;             // the live allocation count hovers around this, split across threads
+    double reallocFraction;         // share of operations that resize a live allocation
+    int threads;                    // > 1 tags every command with t<N>
+    std::vector<AllocationStrategy> strategies;     // each malloc picks one at random
+
+    WorkloadConfig();
+};
+
+// Read a size histogram, either the output of the histogram command ("[low - high] : count")
+// or one "size count" pair per line; false if the file cannot be read or has no buckets
+bool loadSizeHistogram(const std::string &path, std::vector<SizeBucket> &buckets);
+
+// Writes a workload as a trace; the same config and seed always give the same trace
+// Allocation IDs are predicted by counting mallocs per thread, which assumes no malloc fails on replay,
+// so the memory size should leave room for liveTarget allocations of the largest size
+class WorkloadGenerator {
+public:
+    WorkloadGenerator(const WorkloadConfig &config);
+
+    void generate(TraceWriter &writer);
+
+private:
+    struct ThreadState {
+        alloc_id_t nextId;
+        std::deque<alloc_id_t> live;        // in allocation order, long-lived ones are not kept
+        AllocationStrategy lastStrategy;
+    };
+
+    WorkloadConfig config;
+    uint64_t state;                 // xorshift64* state, used instead of <random> so traces match on every platform
+    std::vector<int64_t> bucketTotals;  // running sums of the bucket counts
+
+    uint64_t nextRandom();
+    uint64_t below(uint64_t n);     // uniform in [0, n)
+    double unit();                  // uniform in [0, 1)
+    int64_t drawSize();
+    alloc_id_t takeLive(ThreadState &thread);
+};
+
+#endif
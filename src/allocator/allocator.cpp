@@ -1,16 +1,44 @@
 #include "allocator.h"
 #include<iostream>
-#include <climits>
-#include <iterator>
+#include<algorithm>
 
 using namespace std;
 
-Allocator::Allocator(int size) 
+// Histogram bucket of a free block: floor(log2(size))
+
+static int sizeBucket(mem_size_t size)
+{
+    return 63-__builtin_clzll((uint64_t)size);
+}
+
+// Round address up to a multiple of alignment, a power of two
+
+static mem_size_t alignUp(mem_size_t address, mem_size_t alignment)
+{
+    return (address+alignment-1)&~(alignment-1);
+}
+
+Allocator::Allocator(mem_size_t size) 
 {
     totalSize=size;
     nextId=1;                 // Starting with ID=1
     allocRequests=0;          // Initially the allocation requests are zero
     allocFailures=0;           // Initially the allocation failures are zero
+    compactions=0;
+    compactedBytes=0;
+    reallocs=0;
+    reallocsInPlace=0;
+    reallocCopiedBytes=0;
+    autoCompact=false;
+    headerSize=0;
+    footerSize=0;
+    defaultAlignment=1;
+    paddingBytes=0;
+    headerBytes=0;
+    rover=0;                  // Next fit starts searching from the lowest address
+    freeBytes=0;              // Counted up as free blocks are indexed
+    freeBlockCount=0;
+    freeHistogram.assign(HISTOGRAM_BUCKETS, 0);
 
 
     Block initial_block;          // Creat an initial_block block of entire memory
@@ -18,196 +46,646 @@ Allocator::Allocator(int size)
     initial_block.size=size;    // initial_block block will have the size of entire memory
     initial_block.free=true;    // This block is not in use currently
     initial_block.id=-1;        // This block is free
+    initial_block.alignLog2=0;
+
+    addFreeIndex(blocks.insertAfter(BlockArena::NONE, initial_block));  // Insert the initial_block block into blocks (arena list)
+}
+
+
+
+// Free block index helpers
+// Every free block in the list has exactly one entry in freeBySize, keyed by (size, start),
+// one entry in freeByAddress, keyed by start, and sits in one bin of freeBins
+// The free totals and the histogram are updated at the same points
+
+void Allocator::addFreeIndex(uint32_t b)
+{
+    freeBySize.insert(blocks[b].size, blocks[b].start, b);
+    freeByAddress.insert(blocks[b].start, blocks[b].size, b);
+    freeBins.insert(b, blocks[b].size);
+
+    freeBytes+=blocks[b].size;
+    freeBlockCount++;
+    freeHistogram[sizeBucket(blocks[b].size)]++;
+}
+
+void Allocator::removeFreeIndex(uint32_t b)
+{
+    freeBySize.erase(blocks[b].size, blocks[b].start);
+    freeByAddress.erase(blocks[b].start);
+    freeBins.erase(b, blocks[b].size);
+
+    freeBytes-=blocks[b].size;
+    freeBlockCount--;
+    freeHistogram[sizeBucket(blocks[b].size)]--;
+}
 
-    blocks.push_back(initial_block);  // Insert the initial_block block into blocks (linked list)
+// Used when splitting: the remainder sits where the old free block was in address order,
+// so the address index is updated in place instead of erasing and inserting
+
+void Allocator::moveFreeIndex(uint32_t from, uint32_t to)
+{
+    freeBySize.erase(blocks[from].size, blocks[from].start);
+    freeBySize.insert(blocks[to].size, blocks[to].start, to);
+    freeByAddress.replace(blocks[from].start, blocks[to].start, blocks[to].size, to);
+    freeBins.erase(from, blocks[from].size);
+    freeBins.insert(to, blocks[to].size);
+
+    freeBytes+=blocks[to].size-blocks[from].size;
+    freeHistogram[sizeBucket(blocks[from].size)]--;
+    freeHistogram[sizeBucket(blocks[to].size)]++;
 }
 
 
 
-// Traverse blocks from beginning
-// Find first free block with size >= requested size
+// Allocation mechanics shared by all strategies
 // If exact size: mark allocated
 // If larger: split into allocated + free block
+
+void Allocator::carve(uint32_t b, mem_size_t req_size)
+{
+    if(blocks[b].size > req_size)
+    {
+        Block remaining;
+        remaining.start=blocks[b].start+req_size;
+        remaining.size=blocks[b].size-req_size;
+        remaining.free=true;
+        remaining.id=-1;
+        remaining.alignLog2=0;
+        uint32_t r=blocks.insertAfter(b, remaining);   // may move records, so index blocks[b] again below
+        moveFreeIndex(b, r);
+
+        blocks[b].size=req_size;
+    }
+    else
+        removeFreeIndex(b);
+
+    blocks[b].free=false;
+}
+
+
+
+// The padding goes in front of the header so that the payload after it is aligned
+// The searches look up fitSize() bytes first and check the candidate with fits(); only if its start needs
+// more padding than it has room for do they look again for fitSize() + alignment - 1 bytes, which always fit
 // Assign unique ID to allocated block
 // Return allocation ID
+
+mem_size_t Allocator::fitSize(mem_size_t req_size, mem_size_t &alignment) const
+{
+    if(alignment==0)
+        alignment=defaultAlignment;
+    if(!validAlignment(alignment))
+        return -1;
+    return headerSize+req_size+footerSize;
+}
+
+bool Allocator::fits(uint32_t b, mem_size_t req_size, mem_size_t alignment) const
+{
+    mem_size_t header_start=blocks[b].start+headerSize;
+    mem_size_t padding=alignUp(header_start, alignment)-header_start;
+    return blocks[b].size>=padding+headerSize+req_size+footerSize;
+}
+
+alloc_id_t Allocator::allocateFrom(uint32_t b, mem_size_t req_size, mem_size_t alignment)
+{
+    mem_size_t header_start=blocks[b].start+headerSize;
+    mem_size_t padding=alignUp(header_start, alignment)-header_start;
+    carve(b, padding+headerSize+req_size+footerSize);
+
+    Block &block=blocks[b];
+    block.alignLog2=__builtin_ctzll((uint64_t)alignment);
+    paddingBytes+=padding;
+    headerBytes+=headerSize+footerSize;
+    alloc_id_t newId=nextId++;
+    block.id=newId;
+    idToBlock.insert(newId, b);
+    return newId;
+}
+
+// The padding is what the header's address needed to reach the alignment, 0 for blocks without one
+
+mem_size_t Allocator::paddingOf(uint32_t b) const
+{
+    mem_size_t header_start=blocks[b].start+headerSize;
+    return alignUp(header_start, (mem_size_t)1<<blocks[b].alignLog2)-header_start;
+}
+
+mem_size_t Allocator::payloadSize(uint32_t b) const
+{
+    return blocks[b].size-paddingOf(b)-headerSize-footerSize;
+}
+
+
+
+// Find the lowest-addressed free block with size >= requested size
+// freeByAddress descends straight to it instead of traversing blocks
 // If no block fits, return -1
 
-int Allocator::allocateFirstFit(int req_size) 
+alloc_id_t Allocator::allocateFirstFit(mem_size_t req_size, mem_size_t alignment) 
 {
     allocRequests++;
-    if (req_size <= 0)
+    mem_size_t fit_size=fitSize(req_size, alignment);
+    if (req_size <= 0 || fit_size<0)
     {
         allocFailures++; 
         return -1;
     }
-    for(auto it=blocks.begin() ; it!=blocks.end() ; ++it)
-    {
-        if(it->free)
-        {
-            if(it->size==req_size)
-            {
-                it->free=false;
-                int newId=nextId++;
-                it->id=newId;
-                return newId;
-            }
-            else if(it->size > req_size)
-            {
-                Block remaining;
-                remaining.start=it->start+req_size;
-                remaining.size=it->size-req_size;
-                remaining.free=true;
-                remaining.id=-1;
-                blocks.insert(next(it), remaining);
-
-                it->free=false;
-                it->size=req_size;
-                int newId=nextId++;
-                it->id=newId;
-                return newId;
-            }
-        }
-    }
+
+    if(slabs && req_size<=slabs->largestClass())
+        return allocateSmall(req_size);
+
+    FreeTree::Handle b;
+    if((freeByAddress.findFirst(0, fit_size, b) && fits(b, req_size, alignment))
+       || freeByAddress.findFirst(0, fit_size+alignment-1, b)
+       || (compactFor(fit_size, b) && fits(b, req_size, alignment)))
+        return allocateFrom(b, req_size, alignment);
+
     allocFailures++; 
-    return -1; // placeholder
+    return -1;
 }
 
 
 
-// Traverse ALL free blocks
 // Choose the smallest free block that can fit requested size
+// lowerBound on the (size, start) index gives the smallest fitting size, lowest address on ties
 // Allocation mechanics SAME as First Fit
 
-int Allocator::allocateBestFit(int req_size) 
+alloc_id_t Allocator::allocateBestFit(mem_size_t req_size, mem_size_t alignment) 
 {
     allocRequests++;
-    if (req_size <= 0)
+    mem_size_t fit_size=fitSize(req_size, alignment);
+    if (req_size <= 0 || fit_size<0)
     { 
         allocFailures++; 
         return -1;
     }
 
-    auto best_it=blocks.end();
-    int min_remaining=INT_MAX;
-    for(auto it=blocks.begin() ; it!=blocks.end() ; ++it)
-    {
-        if(it->free)
-        {
-            int remaining=it->size-req_size;
-            if(remaining>=0 && remaining<min_remaining)
-            {
-                min_remaining=remaining;
-                best_it=it;
-            }
-        }
-    }
-    if(best_it!=blocks.end())
-    {
-        if(min_remaining==0)
-        {
-            best_it->free=false;
-            int newId=nextId++;
-            best_it->id=newId;
-            return newId;
-        }
-        else
-        {
-            Block remaining;
-            remaining.start=best_it->start+req_size;
-            remaining.size=min_remaining;
-            remaining.free=true;
-            remaining.id=-1;
-            blocks.insert(next(best_it), remaining);
-
-            best_it->free=false;
-            best_it->size=req_size;
-            int newId=nextId++;
-            best_it->id=newId;
-            return newId;
-        }
-    }
+    if(slabs && req_size<=slabs->largestClass())
+        return allocateSmall(req_size);
+
+    SizeTree::Handle best;
+    if((freeBySize.lowerBound(fit_size, best) && fits(best, req_size, alignment))
+       || freeBySize.lowerBound(fit_size+alignment-1, best)
+       || (compactFor(fit_size, best) && fits(best, req_size, alignment)))
+        return allocateFrom(best, req_size, alignment);
+
     allocFailures++; 
-    return -1; // placeholder
+    return -1;
 }
 
 
 
-// - Traverse ALL free blocks
 // - Choose the largest free block
+// - The largest size is the root maximum of freeByAddress; the leftmost block of that size is the lowest address among equals
 // - Allocation mechanics SAME as First Fit
 
-int Allocator::allocateWorstFit(int req_size) 
+alloc_id_t Allocator::allocateWorstFit(mem_size_t req_size, mem_size_t alignment) 
 {
     allocRequests++;
-    if (req_size <= 0) 
+    mem_size_t fit_size=fitSize(req_size, alignment);
+    if (req_size <= 0 || fit_size<0) 
     {
         allocFailures++; 
         return -1;
     }
 
-    auto worst_it = blocks.end();
-    int max_remaining = INT_MIN;
-    for(auto it=blocks.begin() ; it!=blocks.end() ; ++it)
+    if(slabs && req_size<=slabs->largestClass())
+        return allocateSmall(req_size);
+
+    mem_size_t max_size=freeByAddress.maxSize();
+    FreeTree::Handle worst;
+    if((max_size>=fit_size && freeByAddress.findFirst(0, max_size, worst) && fits(worst, req_size, alignment))
+       || (compactFor(fit_size, worst) && fits(worst, req_size, alignment)))
+        return allocateFrom(worst, req_size, alignment);
+
+    allocFailures++; 
+    return -1;
+}
+
+
+
+// Like First Fit, but the search starts at the rover instead of address 0
+// The rover is left just past the last block handed out by Next Fit
+// If nothing fits above the rover, wrap around and search from the beginning
+
+alloc_id_t Allocator::allocateNextFit(mem_size_t req_size, mem_size_t alignment)
+{
+    allocRequests++;
+    mem_size_t fit_size=fitSize(req_size, alignment);
+    if (req_size <= 0 || fit_size<0)
     {
-        if(it->free)
-        {
-            int remaining=it->size-req_size;
-            if(remaining>=0 && remaining>max_remaining)
-            {
-                max_remaining=remaining;
-                worst_it=it;
-            }
-        }
+        allocFailures++;
+        return -1;
     }
-    if(worst_it!=blocks.end())
+
+    if(slabs && req_size<=slabs->largestClass())
+        return allocateSmall(req_size);
+
+    FreeTree::Handle b;
+    if((freeByAddress.findFirst(rover, fit_size, b) && fits(b, req_size, alignment))
+       || freeByAddress.findFirst(rover, fit_size+alignment-1, b)
+       || (freeByAddress.findFirst(0, fit_size, b) && fits(b, req_size, alignment))
+       || freeByAddress.findFirst(0, fit_size+alignment-1, b)
+       || (compactFor(fit_size, b) && fits(b, req_size, alignment)))
     {
-        if(max_remaining==0)
-        {
-            worst_it->free=false;
-            int newId=nextId++;
-            worst_it->id=newId;
-            return newId;
-        }
-        else
+        alloc_id_t id=allocateFrom(b, req_size, alignment);
+        rover=blocks[b].start+blocks[b].size;
+        return id;
+    }
+
+    allocFailures++;
+    return -1;
+}
+
+
+
+// Two-level segregated fit: take the head of the first non-empty bin whose sizes all fit
+// Good fit rather than best fit, found with bit scans in constant time regardless of the number of free blocks
+// Allocation mechanics SAME as First Fit
+
+alloc_id_t Allocator::allocateTlsf(mem_size_t req_size, mem_size_t alignment)
+{
+    allocRequests++;
+    mem_size_t fit_size=fitSize(req_size, alignment);
+    if (req_size <= 0 || fit_size<0)
+    {
+        allocFailures++;
+        return -1;
+    }
+
+    if(slabs && req_size<=slabs->largestClass())
+        return allocateSmall(req_size);
+
+    uint32_t b;
+    if((freeBins.find(fit_size, b) && fits(b, req_size, alignment))
+       || freeBins.find(fit_size+alignment-1, b)
+       || (compactFor(fit_size, b) && fits(b, req_size, alignment)))
+        return allocateFrom(b, req_size, alignment);
+
+    allocFailures++;
+    return -1;
+}
+
+
+
+// Slabs are carved first fit, like any other block of the heap
+
+alloc_id_t Allocator::allocateSmall(mem_size_t req_size)
+{
+    int c=slabs->classFor(req_size);
+    if(!slabs->hasFreeObject(c))
+    {
+        FreeTree::Handle b;
+        if(!freeByAddress.findFirst(0, slabs->getSlabSize(), b) && !compactFor(slabs->getSlabSize(), b))
         {
-            Block remaining;
-            remaining.start=worst_it->start+req_size;
-            remaining.size=max_remaining;
-            remaining.free=true;
-            remaining.id=-1;
-            blocks.insert(next(worst_it), remaining);
-
-            worst_it->free=false;
-            worst_it->size=req_size;
-            int newId=nextId++;
-            worst_it->id=newId;
-            return newId;
+            allocFailures++;
+            return -1;
         }
+        carve(b, slabs->getSlabSize());
+        blocks[b].id=SLAB_ID;
+        slabs->addSlab(c, blocks[b].start, b);
     }
-    allocFailures++; 
-    return -1; // placeholder
+
+    slabs->allocate(nextId, c, req_size);
+    return nextId++;
+}
+
+
+
+bool Allocator::configureSlabs(const vector<int> &classSizes, int slabSize)
+{
+    if(slabs || classSizes.empty() || slabSize<=0)
+        return false;
+    for(size_t i=0 ; i<classSizes.size() ; i++)
+    {
+        if(classSizes[i]<=0 || classSizes[i]>slabSize)
+            return false;
+        if(i>0 && classSizes[i]<=classSizes[i-1])
+            return false;
+    }
+
+    slabs.reset(new SlabAllocator(classSizes, slabSize));
+    return true;
+}
+
+
+
+bool Allocator::validAlignment(mem_size_t alignment)
+{
+    return alignment>0 && alignment<=MAX_ALIGNMENT && (alignment&(alignment-1))==0;
+}
+
+bool Allocator::validLayout(mem_size_t headerSize, mem_size_t footerSize, mem_size_t alignment)
+{
+    return headerSize>=0 && headerSize<=MAX_ALIGNMENT && footerSize>=0 && footerSize<=MAX_ALIGNMENT
+           && validAlignment(alignment);
+}
+
+bool Allocator::configureLayout(mem_size_t headerSize, mem_size_t footerSize, mem_size_t alignment)
+{
+    if(idToBlock.size()>0 || !validLayout(headerSize, footerSize, alignment))
+        return false;
+
+    this->headerSize=headerSize;
+    this->footerSize=footerSize;
+    defaultAlignment=alignment;
+    return true;
+}
+
+
+
+// The pool is the largest power of two that fits in the largest free block, taken first fit
+// Traces that only use buddy allocation get the whole heap when its size is a power of two
+// Very large pools raise the smallest block size so the smallest order has at most 2^BUDDY_MAX_BLOCKS_LOG2 blocks,
+// which keeps the per-order bitmaps small
+
+bool Allocator::reserveBuddyPool()
+{
+    mem_size_t largest=freeByAddress.maxSize();
+    if(largest<BUDDY_MIN_BLOCK)
+        return false;
+
+    mem_size_t pool_size=BUDDY_MIN_BLOCK;
+    while(pool_size<=largest/2)
+        pool_size*=2;
+
+    FreeTree::Handle b;
+    freeByAddress.findFirst(0, pool_size, b);
+    carve(b, pool_size);
+    blocks[b].id=BUDDY_POOL_ID;
+
+    mem_size_t min_block=max((mem_size_t)BUDDY_MIN_BLOCK, pool_size>>BUDDY_MAX_BLOCKS_LOG2);
+    buddy.reset(new BuddyAllocator(blocks[b].start, pool_size, min_block));
+    return true;
+}
+
+
+
+// Round up to a power of two and allocate from the buddy pool
+// The pool is reserved on the first buddy request
+
+alloc_id_t Allocator::allocateBuddy(mem_size_t req_size)
+{
+    allocRequests++;
+    if (req_size <= 0)
+    {
+        allocFailures++;
+        return -1;
+    }
+
+    if((buddy || reserveBuddyPool()) && buddy->allocate(nextId, req_size))
+        return nextId++;
+
+    allocFailures++;
+    return -1;
+}
+
+
+
+// Dispatch to the allocation function of the given strategy
+
+alloc_id_t Allocator::allocate(AllocationStrategy strategy, mem_size_t req_size, mem_size_t alignment)
+{
+    switch(strategy)
+    {
+        case FIRST_FIT: return allocateFirstFit(req_size, alignment);
+        case NEXT_FIT:  return allocateNextFit(req_size, alignment);
+        case BEST_FIT:  return allocateBestFit(req_size, alignment);
+        case WORST_FIT: return allocateWorstFit(req_size, alignment);
+        case TLSF:      return allocateTlsf(req_size, alignment);
+        case BUDDY:     return allocateBuddy(req_size);
+    }
+    return -1;
 }
 
 
 
-// Find block with given ID
+// Look up block with given ID
 // Mark it as free
 // Reset ID
 // Coalesce adjacent free blocks
+// Unknown IDs and double frees are not in idToBlock, so they are reported without touching the list
+
+bool Allocator::freeBlock(alloc_id_t id) 
+{
+    uint32_t b;
+    if(idToBlock.find(id, b))
+    {
+        idToBlock.erase(id);
+        releaseBlock(b);
+        return true;
+    }
+
+    // buddy and slab allocations are tracked by their engines
+    if(buddy && buddy->release(id))
+        return true;
+
+    uint32_t slab;
+    if(slabs && slabs->release(id, slab))
+    {
+        if(slab!=SlabAllocator::NONE)
+            releaseBlock(slab);
+        return true;
+    }
+    return false;
+}
+
+// Buddy blocks and slab objects resize in place while the new size fits their block or class
+// A block of the list shrinks by splitting off its tail, and grows into the next block if that is free and large enough
+// Otherwise the data moves: a new allocation is made with the strategy (counted as an allocation request),
+// the old one is freed, and the new one takes over the old ID
+
+bool Allocator::reallocate(alloc_id_t id, mem_size_t newSize, AllocationStrategy strategy)
+{
+    if(newSize<=0)
+        return false;
+
+    mem_size_t old_size;
+    mem_size_t alignment=0;
+    bool in_place;
+    uint32_t b;
+    if(idToBlock.find(id, b))
+    {
+        old_size=payloadSize(b);
+        alignment=(mem_size_t)1<<blocks[b].alignLog2;
+        in_place=resizeInPlace(b, newSize);
+    }
+    else if(buddy && buddy->requestedSize(id, old_size))
+        in_place=buddy->resize(id, newSize);
+    else if(slabs && slabs->requestedSize(id, old_size))
+        in_place=slabs->resize(id, newSize);
+    else
+        return false;
+
+    if(!in_place)
+    {
+        alloc_id_t moved=allocate(strategy, newSize, alignment);
+        if(moved==-1)
+            return false;
+        freeBlock(id);
+        renameAllocation(moved, id);
+        nextId--;               // moved was the last ID handed out, it is not used any more
+        reallocCopiedBytes+=min(old_size, newSize);
+    }
+    else
+        reallocsInPlace++;
+    reallocs++;
+    return true;
+}
+
+// The payload does not move, so padding, header and footer stay as they are
+
+bool Allocator::resizeInPlace(uint32_t b, mem_size_t new_payload)
+{
+    mem_size_t size=blocks[b].size;
+    mem_size_t new_size=paddingOf(b)+headerSize+new_payload+footerSize;
+    if(new_size<size)
+    {
+        Block tail;
+        tail.start=blocks[b].start+new_size;
+        tail.size=size-new_size;
+        tail.free=true;
+        tail.id=-1;
+        tail.alignLog2=0;
+        blocks[b].size=new_size;
+        coalesce(blocks.insertAfter(b, tail));      // merges the tail with a free next block
+        return true;
+    }
 
-void Allocator::freeBlock(int id) 
+    mem_size_t extra=new_size-size;
+    if(extra==0)
+        return true;
+    uint32_t next_b=blocks[b].next;
+    if(next_b==BlockArena::NONE || !blocks[next_b].free || blocks[next_b].size<extra)
+        return false;
+
+    removeFreeIndex(next_b);
+    if(blocks[next_b].size==extra)
+        blocks.erase(next_b);
+    else
+    {
+        blocks[next_b].start+=extra;
+        blocks[next_b].size-=extra;
+        addFreeIndex(next_b);
+    }
+    blocks[b].size=new_size;
+    return true;
+}
+
+void Allocator::renameAllocation(alloc_id_t from, alloc_id_t to)
+{
+    uint32_t b;
+    if(idToBlock.find(from, b))
+    {
+        idToBlock.erase(from);
+        idToBlock.insert(to, b);
+        blocks[b].id=to;
+    }
+    else if(!(buddy && buddy->rename(from, to)) && slabs)
+        slabs->rename(from, to);
+}
+
+
+
+// Slide every used block down to the end of the one before it, in a single pass in address order
+// Free blocks are dropped on the way and replaced by one free block covering the rest of the heap
+// A buddy pool or slab moves as a whole, the allocations inside it are reported one by one
+// Arena handles do not change, so idToBlock and the slab handles stay valid
+
+CompactionResult Allocator::compact()
 {
-    for(auto it=blocks.begin() ; it!=blocks.end() ; ++it)
+    CompactionResult result;
+    result.bytesMoved=0;
+
+    mem_size_t next_start=0;
+    uint32_t last=BlockArena::NONE;
+    uint32_t b=blocks.first();
+    while(b!=BlockArena::NONE)
     {
-        if(it->id==id) 
+        uint32_t next_b=blocks[b].next;
+        if(blocks[b].free)
+        {
+            removeFreeIndex(b);
+            blocks.erase(b);
+        }
+        else
         {
-            it->id=-1;
-            it->free=true;
-            coalesce(it);
-            break;
+            Block &block=blocks[b];
+            if(block.start!=next_start)
+            {
+                if(block.id==BUDDY_POOL_ID)
+                    buddy->moveTo(next_start, result.relocations);
+                else if(block.id==SLAB_ID)
+                    slabs->moveSlab(b, next_start, result.relocations);
+                else
+                {
+                    // The padding is redone for the new address; the payload can only move down, so the block never overlaps the next one
+                    result.relocations.push_back({block.id, block.start, next_start});
+                    mem_size_t payload=payloadSize(b);
+                    mem_size_t header_start=next_start+headerSize;
+                    mem_size_t padding=alignUp(header_start, (mem_size_t)1<<block.alignLog2)-header_start;
+                    paddingBytes+=padding-paddingOf(b);
+                    block.size=padding+headerSize+payload+footerSize;
+                }
+                result.bytesMoved+=block.size;
+                block.start=next_start;
+            }
+            next_start+=block.size;
+            last=b;
         }
+        b=next_b;
+    }
+
+    if(next_start<totalSize)
+    {
+        Block tail;
+        tail.start=next_start;
+        tail.size=totalSize-next_start;
+        tail.free=true;
+        tail.id=-1;
+        tail.alignLog2=0;
+        addFreeIndex(blocks.insertAfter(last, tail));
+    }
+    rover=next_start;
+
+    // Buddy blocks are listed in allocation order, everything else is already in address order
+    sort(result.relocations.begin(), result.relocations.end(),
+         [](const Relocation &x, const Relocation &y) { return x.oldStart<y.oldStart; });
+
+    compactions++;
+    compactedBytes+=result.bytesMoved;
+    return result;
+}
+
+void Allocator::setAutoCompact(bool enabled)
+{
+    autoCompact=enabled;
+}
+
+// After compaction all free bytes of the list form a single block, so the request fits exactly when freeBytes covers it
+
+bool Allocator::compactFor(mem_size_t req_size, uint32_t &b)
+{
+    if(!autoCompact || freeBytes<req_size)
+        return false;
+    compact();
+    return freeByAddress.findFirst(0, req_size, b);
+}
+
+
+
+void Allocator::releaseBlock(uint32_t b)
+{
+    if(blocks[b].id>0)
+    {
+        paddingBytes-=paddingOf(b);
+        headerBytes-=headerSize+footerSize;
     }
-    // ID not found → Ignore
+    blocks[b].alignLog2=0;
+    blocks[b].id=-1;
+    blocks[b].free=true;
+    coalesce(b);
 }
 
 
@@ -215,27 +693,27 @@ void Allocator::freeBlock(int id)
 // Merge free blocks
 // Check neighboring blocks of given block and merge them if they are free 
 
-void Allocator::coalesce(list<Block>::iterator it) 
+void Allocator::coalesce(uint32_t b) 
 {
     // Merge with previous block FIRST
-    if(it!=blocks.begin())
+    uint32_t prev_b=blocks[b].prev;
+    if(prev_b!=BlockArena::NONE && blocks[prev_b].free)
     {
-        auto prev_it=prev(it);
-        if(prev_it->free)
-        {
-            prev_it->size += it->size;
-            blocks.erase(it);           // Erase current it
-            it=prev_it;                 // Restore it to prev it (leftmost)
-        }
+        removeFreeIndex(prev_b);
+        blocks[prev_b].size += blocks[b].size;
+        blocks.erase(b);            // Erase current block
+        b=prev_b;                   // Continue from prev block (leftmost)
     }
     // Merge with next block
-    auto next_it=next(it);
-    if(next_it!=blocks.end() && next_it->free)
+    uint32_t next_b=blocks[b].next;
+    if(next_b!=BlockArena::NONE && blocks[next_b].free)
     {
-        it->size += next_it->size;
-        blocks.erase(next_it);
+        removeFreeIndex(next_b);
+        blocks[b].size += blocks[next_b].size;
+        blocks.erase(next_b);
     }
 
+    addFreeIndex(b);            // Index the merged block under its final size
 }
 
 
@@ -247,29 +725,96 @@ void Allocator::dumpMemory()
 {
     cout<<"Memory Dump"<<endl;
 
-    for(auto &block:blocks)
+    for(uint32_t b=blocks.first() ; b!=BlockArena::NONE ; b=blocks[b].next)
     {
+        const Block &block=blocks[b];
         cout<<"["<<block.start<<" - "<<block.start+block.size-1<<"] ";
 
         if(block.free) 
             cout<<"FREE"<<endl;
+        else if(block.id==SLAB_ID)
+        {
+            int class_size, used, capacity;
+            slabs->slabInfo(b, class_size, used, capacity);
+            cout<<"SLAB (class = "<<class_size<<", used = "<<used<<"/"<<capacity<<")"<<endl;
+        }
+        else if(block.id==BUDDY_POOL_ID)
+        {
+            cout<<"BUDDY POOL"<<endl;
+            buddy->dump();
+        }
+        else if(paddingOf(b)>0 || headerSize+footerSize>0)
+            cout<<"USED "<<"(ID = "<<block.id<<", payload = "<<payloadSize(b)<<" at "<<block.start+paddingOf(b)+headerSize<<")"<<endl;
         else 
             cout<<"USED "<<"(ID = "<<block.id<<")"<<endl;
     }
 }
 
-//
+// Internal fragmentation of the list is its alignment padding and headers and footers, zero without configureLayout
+// Buddy blocks and slab objects add what they round requests up by
+// Free space inside the buddy pool counts as free memory, and its blocks compete for the largest free block
+// Slabs count as used memory, their occupancy is reported per class
+// Nothing here walks the block list, the free totals are kept up to date by the free block indexes
+
+AllocatorStats Allocator::getStats() const
+{
+    AllocatorStats stats;
+    stats.totalSize=totalSize;
+    stats.freeBytes=freeBytes;
+    stats.freeBlocks=freeBlockCount;
+    stats.largestFreeBlock=freeByAddress.maxSize();
+    stats.internalFragmentation=paddingBytes+headerBytes;
+    stats.allocRequests=allocRequests;
+    stats.allocFailures=allocFailures;
+    stats.compactions=compactions;
+    stats.compactedBytes=compactedBytes;
+    stats.reallocs=reallocs;
+    stats.reallocsInPlace=reallocsInPlace;
+    stats.reallocCopiedBytes=reallocCopiedBytes;
+    stats.alignmentPadding=paddingBytes;
+    stats.headerBytes=headerBytes;
+
+    if(buddy)
+    {
+        stats.freeBytes+=buddy->getPoolSize()-buddy->usedBytes();
+        stats.freeBlocks+=buddy->freeBlockCount();
+        stats.largestFreeBlock=max(stats.largestFreeBlock,buddy->largestFreeBlock());
+        stats.internalFragmentation+=buddy->internalFragmentation();
+    }
+    if(slabs)
+        stats.internalFragmentation+=slabs->internalFragmentation();
+
+    stats.usedBytes=totalSize-stats.freeBytes;
+    return stats;
+}
+
+
+
+vector<int> Allocator::getFreeHistogram() const
+{
+    vector<int> histogram=freeHistogram;
+    if(buddy)
+        buddy->addToHistogram(histogram);
+    return histogram;
+}
+
+void Allocator::printFreeHistogram() const
+{
+    cout<<"Free Block Histogram"<<endl;
+    vector<int> histogram=getFreeHistogram();
+    for(int i=0 ; i<HISTOGRAM_BUCKETS ; i++)
+        if(histogram[i]>0)
+            cout<<"["<<((uint64_t)1<<i)<<" - "<<((uint64_t)1<<(i+1))-1<<"] : "<<histogram[i]<<endl;
+}
+
+
+
 void Allocator::printStats()
 {
-    cout<<"Internal Fragmentation  = 0"<<endl; // Internal Fragmentation is zero in variable partitioning
-    int free_size=0;
-    int largest_free_size=0;
-    for(auto &block:blocks)
-        if(block.free)
-        {
-            free_size+=block.size;
-            largest_free_size=max(largest_free_size,block.size);
-        }
+    AllocatorStats stats=getStats();
+    cout<<"Internal Fragmentation  = "<<stats.internalFragmentation<<endl;
+    mem_size_t free_size=stats.freeBytes;
+    mem_size_t largest_free_size=stats.largestFreeBlock;
 
     cout<<"Total Memory = "<<totalSize<<endl;
     cout<<"Total Memory Used = "<<totalSize-free_size<<endl;
@@ -284,4 +829,128 @@ void Allocator::printStats()
         cout<<"Allocation Failure Rate = "<<(double)(allocFailures)/allocRequests*100<<"%"<<endl;  // To avoid ZeroDivisionEror
     else 
         cout<<"Allocation Failure Rate = 0%"<<endl;
+
+    if(stats.alignmentPadding>0 || stats.headerBytes>0)
+        cout<<"Block Overhead = "<<stats.alignmentPadding+stats.headerBytes<<" (alignment padding = "<<stats.alignmentPadding
+            <<", headers and footers = "<<stats.headerBytes<<")"<<endl;
+
+    if(compactions>0)
+        cout<<"Compactions = "<<compactions<<" ("<<compactedBytes<<" bytes moved)"<<endl;
+
+    if(reallocs>0)
+        cout<<"Reallocations = "<<reallocs<<" ("<<reallocsInPlace<<" in place, "<<reallocCopiedBytes<<" bytes copied)"<<endl;
+
+    if(slabs)
+        slabs->printStats();
+}
+
+
+
+// Snapshots
+
+bool Allocator::saveSnapshot(const char *path) const
+{
+    SnapshotWriter out;
+    if(!out.open(path))
+        return false;
+
+    out.put(totalSize);
+    out.put(nextId);
+    out.put(allocRequests);
+    out.put(allocFailures);
+    out.put(compactions);
+    out.put(compactedBytes);
+    out.put(reallocs);
+    out.put(reallocsInPlace);
+    out.put(reallocCopiedBytes);
+    out.put(rover);
+    out.put(autoCompact);
+    out.put(headerSize);
+    out.put(footerSize);
+    out.put(defaultAlignment);
+    out.put(paddingBytes);
+    out.put(headerBytes);
+    out.put(freeBytes);
+    out.put(freeBlockCount);
+    out.putVector(freeHistogram);
+
+    blocks.save(out);
+    freeBySize.save(out);
+    freeByAddress.save(out);
+    freeBins.save(out);
+    idToBlock.save(out);
+
+    out.put((bool)buddy);
+    if(buddy)
+        buddy->save(out);
+    out.put((bool)slabs);
+    if(slabs)
+        slabs->save(out);
+    return out.close();
+}
+
+// Everything is loaded into a fresh allocator and checked first, so a bad snapshot leaves this one untouched
+
+bool Allocator::loadSnapshot(const char *path)
+{
+    SnapshotReader in;
+    if(!in.open(path))
+        return false;
+
+    Allocator restored(1);
+    bool hasBuddy, hasSlabs;
+    bool ok=in.get(restored.totalSize) && in.get(restored.nextId) && restored.nextId>0 && restored.nextId<=MAX_ALLOC_ID
+        && in.get(restored.allocRequests)
+        && in.get(restored.allocFailures) && in.get(restored.compactions) && in.get(restored.compactedBytes)
+        && in.get(restored.reallocs) && in.get(restored.reallocsInPlace) && in.get(restored.reallocCopiedBytes)
+        && in.get(restored.rover) && in.get(restored.autoCompact) && in.get(restored.headerSize)
+        && in.get(restored.footerSize) && in.get(restored.defaultAlignment) && in.get(restored.paddingBytes)
+        && in.get(restored.headerBytes) && in.get(restored.freeBytes)
+        && in.get(restored.freeBlockCount) && in.getVector(restored.freeHistogram)
+        && restored.freeHistogram.size()==HISTOGRAM_BUCKETS && restored.blocks.load(in);
+
+    // Each structure checks its own links when it loads; the handles into the arena are checked against its size
+    uint32_t handles=restored.blocks.capacity();
+    ok=ok && restored.freeBySize.load(in, handles) && restored.freeByAddress.load(in, handles)
+        && restored.freeBins.load(in, handles) && restored.idToBlock.load(in, handles);
+
+    ok=ok && in.get(hasBuddy);
+    if(ok && hasBuddy)
+    {
+        restored.buddy.reset(new BuddyAllocator(0, 1, 1));      // placeholder, load overwrites all of it
+        ok=restored.buddy->load(in);
+    }
+    ok=ok && in.get(hasSlabs);
+    if(ok && hasSlabs)
+    {
+        restored.slabs.reset(new SlabAllocator(vector<int>(), 1));
+        ok=restored.slabs->load(in, handles);
+    }
+    if(!ok || !in.atEnd())
+        return false;
+
+    // The blocks must tile the heap, and the free totals and both trees must agree with the free blocks of the list
+    mem_size_t end=0;
+    mem_size_t free_bytes=0;
+    uint32_t free_blocks=0;
+    for(uint32_t b=restored.blocks.first() ; b!=BlockArena::NONE ; b=restored.blocks[b].next)
+    {
+        const Block &block=restored.blocks[b];
+        if(block.start!=end || block.size<=0 || block.size>restored.totalSize-end || block.free!=(block.id==-1)
+           || (block.id<=0 && block.alignLog2!=0))
+            return false;
+        end+=block.size;
+        if(block.free)
+        {
+            free_bytes+=block.size;
+            free_blocks++;
+        }
+    }
+    if(end!=restored.totalSize || free_bytes!=restored.freeBytes || free_blocks!=(uint32_t)restored.freeBlockCount
+       || restored.freeBySize.size()!=free_blocks || restored.freeByAddress.size()!=free_blocks)
+        return false;
+
+    *this=move(restored);
+    return true;
 }
+
@@ -0,0 +1,117 @@
+#include "block_arena.h"
+
+using namespace std;
+
+BlockArena::BlockArena()
+{
+    head=NONE;
+    freeSlots=NONE;
+    count=0;
+}
+
+
+
+// Reuse a recycled slot if there is one, otherwise grow the array
+
+uint32_t BlockArena::insertAfter(uint32_t pos, const Block &block)
+{
+    uint32_t i;
+    if(freeSlots!=NONE)
+    {
+        i=freeSlots;
+        freeSlots=records[i].next;
+        records[i]=block;
+    }
+    else
+    {
+        i=(uint32_t)records.size();
+        records.push_back(block);
+    }
+
+    Block &b=records[i];
+    b.prev=pos;
+    if(pos==NONE)
+    {
+        b.next=head;
+        head=i;
+    }
+    else
+    {
+        b.next=records[pos].next;
+        records[pos].next=i;
+    }
+    if(b.next!=NONE)
+        records[b.next].prev=i;
+
+    count++;
+    return i;
+}
+
+
+
+void BlockArena::erase(uint32_t i)
+{
+    Block &b=records[i];
+    if(b.prev!=NONE)
+        records[b.prev].next=b.next;
+    else
+        head=b.next;
+    if(b.next!=NONE)
+        records[b.next].prev=b.prev;
+
+    b.next=freeSlots;
+    freeSlots=i;
+    count--;
+}
+
+
+
+void BlockArena::clear()
+{
+    records.clear();
+    head=NONE;
+    freeSlots=NONE;
+    count=0;
+}
+
+
+
+void BlockArena::save(SnapshotWriter &out) const
+{
+    out.putVector(records);
+    out.put(head);
+    out.put(freeSlots);
+    out.put(count);
+}
+
+// The address-order list is walked from head, checking each back link, then the chain of recycled slots;
+// a record seen twice means a cycle or a slot that is both linked and recycled
+
+bool BlockArena::load(SnapshotReader &in)
+{
+    if(!in.getVector(records) || !in.get(head) || !in.get(freeSlots) || !in.get(count) || records.size()>=NONE)
+        return false;
+
+    vector<bool> seen(records.size(), false);
+    uint32_t linked=0;
+    uint32_t prev=NONE;
+    for(uint32_t i=head ; i!=NONE ; i=records[i].next)
+    {
+        // Alignments are rebuilt as 1 << alignLog2
+        if(i>=records.size() || seen[i] || records[i].prev!=prev || records[i].alignLog2>62)
+            return false;
+        seen[i]=true;
+        prev=i;
+        linked++;
+    }
+
+    uint32_t recycled=0;
+    for(uint32_t i=freeSlots ; i!=NONE ; i=records[i].next)
+    {
+        if(i>=records.size() || seen[i])
+            return false;
+        seen[i]=true;
+        recycled++;
+    }
+    return linked==count && linked+recycled==records.size();
+}
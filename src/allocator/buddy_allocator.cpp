@@ -0,0 +1,415 @@
+#include "buddy_allocator.h"
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// log2 of a power of two, capped at 62 so the shift stays inside mem_size_t; no pool is larger than 2^62
+
+static const int MAX_ORDER_LIMIT=62;
+
+static int orderOf(mem_size_t size)
+{
+    int order=0;
+    while(order<MAX_ORDER_LIMIT && ((mem_size_t)1<<order)<size)
+        order++;
+    return order;
+}
+
+BuddyAllocator::BuddyAllocator(mem_size_t base, mem_size_t poolSize, mem_size_t minBlockSize)
+{
+    this->base=base;
+    minOrder=orderOf(minBlockSize);
+    maxOrder=orderOf(poolSize);
+    used=0;
+    requested=0;
+
+    freeLists.resize(maxOrder+1);
+    freeBits.resize(maxOrder+1);
+    freeCount.assign(maxOrder+1, 0);
+    for(int order=minOrder ; order<=maxOrder ; order++)
+    {
+        mem_size_t blocks_in_order=(mem_size_t)1<<(maxOrder-order);
+        freeBits[order].assign((blocks_in_order+63)/64, 0);
+    }
+
+    pushFree(maxOrder, 0);      // the whole pool starts as one free block
+}
+
+
+
+// Bitmap helpers
+
+bool BuddyAllocator::isFree(int order, mem_size_t offset) const
+{
+    mem_size_t bit=offset>>order;
+    return (freeBits[order][bit>>6]>>(bit&63))&1;
+}
+
+void BuddyAllocator::pushFree(int order, mem_size_t offset)
+{
+    mem_size_t bit=offset>>order;
+    freeBits[order][bit>>6] |= (uint64_t)1<<(bit&63);
+    freeCount[order]++;
+    freeLists[order].push_back(offset);
+}
+
+// The stale list entry stays behind, popFree skips it
+// Once stale entries outnumber the free blocks the list is compacted, so a list never holds more than
+// twice its free blocks and the compaction work is paid for by the removals that made the entries stale
+
+void BuddyAllocator::removeFree(int order, mem_size_t offset)
+{
+    mem_size_t bit=offset>>order;
+    freeBits[order][bit>>6] &= ~((uint64_t)1<<(bit&63));
+    freeCount[order]--;
+    if(freeLists[order].size()>2*(size_t)freeCount[order])
+        compactFree(order);
+}
+
+// A block freed again after going stale has an older entry too; popFree reaches the newest one first,
+// so walking down from the top keeps the newest entry of each free block, clearing its bit meanwhile
+// so the older ones are dropped. The bits are set again afterwards and the kept entries keep their order
+
+void BuddyAllocator::compactFree(int order)
+{
+    vector<mem_size_t> &list=freeLists[order];
+    size_t top=list.size();
+    for(size_t i=list.size() ; i-->0 ; )
+    {
+        mem_size_t offset=list[i];
+        if(isFree(order, offset))
+        {
+            mem_size_t bit=offset>>order;
+            freeBits[order][bit>>6] &= ~((uint64_t)1<<(bit&63));
+            list[--top]=offset;
+        }
+    }
+    list.erase(list.begin(), list.begin()+top);
+    for(mem_size_t offset:list)
+    {
+        mem_size_t bit=offset>>order;
+        freeBits[order][bit>>6] |= (uint64_t)1<<(bit&63);
+    }
+}
+
+mem_size_t BuddyAllocator::popFree(int order)
+{
+    vector<mem_size_t> &list=freeLists[order];
+    while(!list.empty())
+    {
+        mem_size_t offset=list.back();
+        list.pop_back();
+        if(isFree(order, offset))
+        {
+            removeFree(order, offset);
+            return offset;
+        }
+    }
+    return -1;
+}
+
+
+
+// Round the request up to a power of two
+// Take a free block from the smallest order that has one
+// Split it in halves, keeping the lower half and freeing the upper half, until it has the requested order
+// Requests larger than the whole pool are rejected before rounding, which could not represent them
+
+bool BuddyAllocator::allocate(alloc_id_t id, mem_size_t req_size)
+{
+    if(req_size<=0 || req_size>((mem_size_t)1<<maxOrder))
+        return false;
+
+    int order=max(minOrder, orderOf(req_size));
+    if(order>maxOrder)
+        return false;
+
+    int from=order;
+    while(from<=maxOrder && freeCount[from]==0)
+        from++;
+    if(from>maxOrder)
+        return false;
+
+    mem_size_t offset=popFree(from);
+    while(from>order)
+    {
+        from--;
+        pushFree(from, offset+((mem_size_t)1<<from));
+    }
+
+    Allocation allocation;
+    allocation.id=id;
+    allocation.offset=offset;
+    allocation.order=order;
+    allocation.size=req_size;
+
+    uint32_t slot;
+    if(!freeSlots.empty())
+    {
+        slot=freeSlots.back();
+        freeSlots.pop_back();
+        allocations[slot]=allocation;
+    }
+    else
+    {
+        slot=(uint32_t)allocations.size();
+        allocations.push_back(allocation);
+    }
+    idToAllocation.insert(id, slot);
+
+    used+=(mem_size_t)1<<order;
+    requested+=req_size;
+    return true;
+}
+
+
+
+// Merge with the buddy (offset XOR block size) for as long as it is free
+
+bool BuddyAllocator::release(alloc_id_t id)
+{
+    uint32_t slot;
+    if(!idToAllocation.find(id, slot))
+        return false;
+    idToAllocation.erase(id);
+    freeSlots.push_back(slot);
+    allocations[slot].id=-1;
+
+    mem_size_t offset=allocations[slot].offset;
+    int order=allocations[slot].order;
+    used-=(mem_size_t)1<<order;
+    requested-=allocations[slot].size;
+
+    while(order<maxOrder)
+    {
+        mem_size_t buddy=offset^((mem_size_t)1<<order);
+        if(!isFree(order, buddy))
+            break;
+        removeFree(order, buddy);
+        offset=min(offset, buddy);
+        order++;
+    }
+    pushFree(order, offset);
+    return true;
+}
+
+
+
+bool BuddyAllocator::requestedSize(alloc_id_t id, mem_size_t &size) const
+{
+    uint32_t slot;
+    if(!idToAllocation.find(id, slot))
+        return false;
+    size=allocations[slot].size;
+    return true;
+}
+
+// A smaller size keeps the whole block, it is not split
+
+bool BuddyAllocator::resize(alloc_id_t id, mem_size_t newSize)
+{
+    uint32_t slot;
+    if(!idToAllocation.find(id, slot))
+        return false;
+    Allocation &allocation=allocations[slot];
+    if(newSize<=0 || newSize>((mem_size_t)1<<allocation.order))
+        return false;
+    requested+=newSize-allocation.size;
+    allocation.size=newSize;
+    return true;
+}
+
+bool BuddyAllocator::rename(alloc_id_t from, alloc_id_t to)
+{
+    uint32_t slot;
+    if(!idToAllocation.find(from, slot))
+        return false;
+    idToAllocation.erase(from);
+    idToAllocation.insert(to, slot);
+    allocations[slot].id=to;
+    return true;
+}
+
+
+
+mem_size_t BuddyAllocator::getBase() const
+{
+    return base;
+}
+
+mem_size_t BuddyAllocator::getPoolSize() const
+{
+    return (mem_size_t)1<<maxOrder;
+}
+
+mem_size_t BuddyAllocator::usedBytes() const
+{
+    return used;
+}
+
+mem_size_t BuddyAllocator::requestedBytes() const
+{
+    return requested;
+}
+
+mem_size_t BuddyAllocator::internalFragmentation() const
+{
+    return used-requested;
+}
+
+mem_size_t BuddyAllocator::largestFreeBlock() const
+{
+    for(int order=maxOrder ; order>=minOrder ; order--)
+        if(freeCount[order]>0)
+            return (mem_size_t)1<<order;
+    return 0;
+}
+
+
+
+// Offsets are relative to the pool, so only the base changes
+
+void BuddyAllocator::moveTo(mem_size_t newBase, vector<Relocation> &relocations)
+{
+    for(auto &allocation:allocations)
+        if(allocation.id!=-1)
+            relocations.push_back({allocation.id, base+allocation.offset, newBase+allocation.offset});
+    base=newBase;
+}
+
+
+
+int BuddyAllocator::freeBlockCount() const
+{
+    int count=0;
+    for(int order=minOrder ; order<=maxOrder ; order++)
+        count+=freeCount[order];
+    return count;
+}
+
+void BuddyAllocator::addToHistogram(vector<int> &histogram) const
+{
+    for(int order=minOrder ; order<=maxOrder ; order++)
+        histogram[order]+=freeCount[order];
+}
+
+
+
+// Collect free blocks from the bitmaps and used blocks from the allocation table,
+// then print them sorted by address
+// Zero bitmap words are skipped whole, so large pools with few free blocks dump quickly
+
+void BuddyAllocator::dump() const
+{
+    struct Entry {
+        mem_size_t offset;
+        int order;
+        alloc_id_t id;      // -1 if free
+    };
+    vector<Entry> entries;
+
+    for(int order=minOrder ; order<=maxOrder ; order++)
+        for(size_t word=0 ; word<freeBits[order].size() ; word++)
+            for(uint64_t bits=freeBits[order][word] ; bits!=0 ; bits&=bits-1)
+            {
+                mem_size_t bit=(mem_size_t)(word*64+__builtin_ctzll(bits));
+                entries.push_back({bit<<order, order, -1});
+            }
+
+    for(auto &allocation:allocations)
+        if(allocation.id!=-1)
+            entries.push_back({allocation.offset, allocation.order, allocation.id});
+
+    sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.offset<b.offset; });
+
+    for(auto &entry:entries)
+    {
+        mem_size_t start=base+entry.offset;
+        cout<<"  ["<<start<<" - "<<start+((mem_size_t)1<<entry.order)-1<<"] ";
+        if(entry.id==-1)
+            cout<<"FREE"<<endl;
+        else
+            cout<<"USED "<<"(ID = "<<entry.id<<")"<<endl;
+    }
+}
+
+
+
+void BuddyAllocator::save(SnapshotWriter &out) const
+{
+    out.put(base);
+    out.put(minOrder);
+    out.put(maxOrder);
+    for(int order=0 ; order<=maxOrder ; order++)
+    {
+        out.putVector(freeLists[order]);
+        out.putVector(freeBits[order]);
+    }
+    out.putVector(freeCount);
+    out.putVector(allocations);
+    out.putVector(freeSlots);
+    idToAllocation.save(out);
+    out.put(used);
+    out.put(requested);
+}
+
+bool BuddyAllocator::load(SnapshotReader &in)
+{
+    if(!in.get(base) || !in.get(minOrder) || !in.get(maxOrder) || minOrder<0 || maxOrder<minOrder || maxOrder>MAX_ORDER_LIMIT)
+        return false;
+    freeLists.assign(maxOrder+1, vector<mem_size_t>());
+    freeBits.assign(maxOrder+1, vector<uint64_t>());
+    for(int order=0 ; order<=maxOrder ; order++)
+    {
+        if(!in.getVector(freeLists[order]) || !in.getVector(freeBits[order]))
+            return false;
+    }
+    if(!in.getVector(freeCount) || freeCount.size()!=(size_t)maxOrder+1 || !in.getVector(allocations)
+       || !in.getVector(freeSlots) || !idToAllocation.load(in, (uint32_t)allocations.size())
+       || !in.get(used) || !in.get(requested))
+        return false;
+
+    // Each order's bitmap has one bit per block of the pool, its count matches the set bits,
+    // and every set bit has an entry in the free list for popFree to find; stale entries may lie anywhere in the pool
+    mem_size_t pool_size=(mem_size_t)1<<maxOrder;
+    for(int order=0 ; order<=maxOrder ; order++)
+    {
+        size_t words=order<minOrder ? 0 : (size_t)((((mem_size_t)1<<(maxOrder-order))+63)/64);
+        if(freeBits[order].size()!=words || (words==0 && !freeLists[order].empty()))
+            return false;
+
+        vector<uint64_t> listed(words, 0);
+        for(mem_size_t offset:freeLists[order])
+        {
+            if(offset<0 || offset>=pool_size || (offset&(((mem_size_t)1<<order)-1))!=0)
+                return false;
+            mem_size_t bit=offset>>order;
+            listed[bit>>6] |= freeBits[order][bit>>6] & (uint64_t)1<<(bit&63);
+        }
+
+        int bits=0;
+        for(size_t w=0 ; w<words ; w++)
+        {
+            if(listed[w]!=freeBits[order][w])
+                return false;
+            bits+=__builtin_popcountll(freeBits[order][w]);
+        }
+        if(freeCount[order]!=bits)
+            return false;
+    }
+
+    // Released entries keep the block they last held, so every entry must fit the pool
+    for(auto &allocation:allocations)
+    {
+        if(allocation.order<minOrder || allocation.order>maxOrder || allocation.offset<0
+           || allocation.offset>pool_size-((mem_size_t)1<<allocation.order))
+            return false;
+    }
+    for(uint32_t slot:freeSlots)
+    {
+        if(slot>=allocations.size())
+            return false;
+    }
+    return true;
+}
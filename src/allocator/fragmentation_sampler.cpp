@@ -0,0 +1,84 @@
+#include "fragmentation_sampler.h"
+
+using namespace std;
+
+const char SAMPLE_MAGIC[8]={'M', 'S', 'S', 'A', 'M', 'P', 'L', 1};
+
+FragmentationSampler::FragmentationSampler(size_t capacity, int64_t interval)
+{
+    ring.resize(max<size_t>(1, capacity));
+    next=0;
+    count=0;
+    this->interval=interval;
+    countdown=interval>0 ? interval : -1;   // counting down from -1 never reaches 0
+    operations=0;
+    overwritten=0;
+}
+
+
+
+// Interval and failure samples share the countdown, so a failure does not shift the interval grid
+
+void FragmentationSampler::take(const Allocator &allocator, bool failed)
+{
+    if(countdown==0)
+        countdown=interval;
+
+    AllocatorStats stats=allocator.getStats();
+    FragmentationSample &sample=ring[next];
+    sample.operation=operations;
+    sample.failure=failed ? 1 : 0;
+    sample.totalSize=stats.totalSize;
+    sample.usedBytes=stats.usedBytes;
+    sample.freeBytes=stats.freeBytes;
+    sample.largestFreeBlock=stats.largestFreeBlock;
+    sample.freeBlocks=stats.freeBlocks;
+
+    next=next+1==ring.size() ? 0 : next+1;
+    if(count<ring.size())
+        count++;
+    else
+        overwritten++;
+}
+
+size_t FragmentationSampler::size() const
+{
+    return count;
+}
+
+int64_t FragmentationSampler::dropped() const
+{
+    return overwritten;
+}
+
+const FragmentationSample &FragmentationSampler::at(size_t i) const
+{
+    size_t oldest=count<ring.size() ? 0 : next;
+    return ring[(oldest+i)%ring.size()];
+}
+
+
+
+void FragmentationSampler::writeCsv(ostream &out) const
+{
+    out<<"operation,event,utilization,external_fragmentation,largest_free_block,free_blocks,used_bytes,free_bytes"<<endl;
+    for(size_t i=0 ; i<count ; i++)
+    {
+        const FragmentationSample &sample=at(i);
+        double utilization=sample.totalSize>0 ? (double)sample.usedBytes/sample.totalSize*100 : 0;
+        double external=sample.freeBytes>0 ? (double)(sample.freeBytes-sample.largestFreeBlock)/sample.freeBytes*100 : 0;
+        out<<sample.operation<<","<<(sample.failure ? "failure" : "interval")<<","<<utilization<<","<<external
+           <<","<<sample.largestFreeBlock<<","<<sample.freeBlocks<<","<<sample.usedBytes<<","<<sample.freeBytes<<"\n";
+    }
+    out<<flush;
+}
+
+void FragmentationSampler::writeBinary(ostream &out) const
+{
+    out.write(SAMPLE_MAGIC, sizeof(SAMPLE_MAGIC));
+    uint64_t samples=count;
+    out.write((const char*)&samples, sizeof(samples));
+    for(size_t i=0 ; i<count ; i++)
+        out.write((const char*)&at(i), sizeof(FragmentationSample));
+    out<<flush;
+}
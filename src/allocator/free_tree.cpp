@@ -0,0 +1,376 @@
+#include "free_tree.h"
+#include <climits>
+
+using namespace std;
+
+// Shared check of a restored node pool: every node is either reached from the root exactly once or a recycled slot,
+// and every reached node holds a handle below handles
+
+template<class Node>
+static bool validPool(const vector<Node> &nodes, const vector<int> &freeSlots, int root, uint32_t handles)
+{
+    if(nodes.size()>(size_t)INT_MAX)
+        return false;
+
+    vector<bool> seen(nodes.size(), false);
+    vector<int> pending;
+    if(root!=-1)
+        pending.push_back(root);
+    size_t reached=0;
+    while(!pending.empty())
+    {
+        int n=pending.back();
+        pending.pop_back();
+        if(n<0 || n>=(int)nodes.size() || seen[n] || nodes[n].handle>=handles)
+            return false;
+        seen[n]=true;
+        reached++;
+        if(nodes[n].left!=-1)
+            pending.push_back(nodes[n].left);
+        if(nodes[n].right!=-1)
+            pending.push_back(nodes[n].right);
+    }
+
+    for(int n:freeSlots)
+    {
+        if(n<0 || n>=(int)nodes.size() || seen[n])
+            return false;
+        seen[n]=true;
+    }
+    return reached+freeSlots.size()==nodes.size();
+}
+
+FreeTree::FreeTree()
+{
+    root=-1;                // -1 marks an empty subtree
+    seed=2463534242u;       // fixed seed keeps the tree shape reproducible
+}
+
+
+
+// Take a node from the recycled slots before growing the pool
+
+int FreeTree::newNode(mem_size_t start, mem_size_t size, Handle handle)
+{
+    // xorshift32 priority
+    seed^=seed<<13;
+    seed^=seed>>17;
+    seed^=seed<<5;
+
+    Node node;
+    node.start=start;
+    node.size=size;
+    node.maxSize=size;
+    node.priority=seed;
+    node.left=-1;
+    node.right=-1;
+    node.handle=handle;
+
+    if(!freeSlots.empty())
+    {
+        int n=freeSlots.back();
+        freeSlots.pop_back();
+        nodes[n]=node;
+        return n;
+    }
+    nodes.push_back(node);
+    return (int)nodes.size()-1;
+}
+
+
+
+// Recompute the subtree maximum from the children
+
+void FreeTree::update(int n)
+{
+    Node &node=nodes[n];
+    node.maxSize=node.size;
+    if(node.left!=-1 && nodes[node.left].maxSize>node.maxSize)
+        node.maxSize=nodes[node.left].maxSize;
+    if(node.right!=-1 && nodes[node.right].maxSize>node.maxSize)
+        node.maxSize=nodes[node.right].maxSize;
+}
+
+
+
+void FreeTree::split(int n, mem_size_t key, int &left, int &right)
+{
+    if(n==-1)
+    {
+        left=-1;
+        right=-1;
+        return;
+    }
+    if(nodes[n].start<key)
+    {
+        split(nodes[n].right, key, nodes[n].right, right);
+        left=n;
+    }
+    else
+    {
+        split(nodes[n].left, key, left, nodes[n].left);
+        right=n;
+    }
+    update(n);
+}
+
+
+
+// All starts in left are lower than all starts in right
+
+int FreeTree::merge(int left, int right)
+{
+    if(left==-1) return right;
+    if(right==-1) return left;
+
+    if(nodes[left].priority>nodes[right].priority)
+    {
+        nodes[left].right=merge(nodes[left].right, right);
+        update(left);
+        return left;
+    }
+    nodes[right].left=merge(left, nodes[right].left);
+    update(right);
+    return right;
+}
+
+
+
+void FreeTree::insert(mem_size_t start, mem_size_t size, Handle handle)
+{
+    int left, right;
+    split(root, start, left, right);
+    root=merge(merge(left, newNode(start, size, handle)), right);
+}
+
+
+
+void FreeTree::erase(mem_size_t start)
+{
+    int left, middle, right;
+    split(root, start, left, middle);
+    split(middle, start+1, middle, right);
+    if(middle!=-1)
+        freeSlots.push_back(middle);
+    root=merge(left, right);
+}
+
+
+
+// Descend to the entry and fix the subtree maximums on the way back up
+// No rotations are needed since the key order does not change
+
+void FreeTree::replace(int n, mem_size_t old_start, mem_size_t new_start, mem_size_t new_size, Handle handle)
+{
+    if(n==-1)
+        return;
+    Node &node=nodes[n];
+    if(node.start==old_start)
+    {
+        node.start=new_start;
+        node.size=new_size;
+        node.handle=handle;
+    }
+    else if(old_start<node.start)
+        replace(node.left, old_start, new_start, new_size, handle);
+    else
+        replace(node.right, old_start, new_start, new_size, handle);
+    update(n);
+}
+
+void FreeTree::replace(mem_size_t old_start, mem_size_t new_start, mem_size_t new_size, Handle handle)
+{
+    replace(root, old_start, new_start, new_size, handle);
+}
+
+
+
+bool FreeTree::empty() const
+{
+    return root==-1;
+}
+
+mem_size_t FreeTree::maxSize() const
+{
+    return root==-1 ? 0 : nodes[root].maxSize;
+}
+
+
+
+// Skip any subtree whose maximum is too small
+// Nodes below `from` only send the search to their right subtree
+
+int FreeTree::findFirstNode(int n, mem_size_t from, mem_size_t req_size) const
+{
+    if(n==-1 || nodes[n].maxSize<req_size)
+        return -1;
+
+    const Node &node=nodes[n];
+    if(node.start<from)
+        return findFirstNode(node.right, from, req_size);
+
+    int found=findFirstNode(node.left, from, req_size);
+    if(found!=-1)
+        return found;
+    if(node.size>=req_size)
+        return n;
+    return findFirstNode(node.right, from, req_size);
+}
+
+bool FreeTree::findFirst(mem_size_t from, mem_size_t req_size, Handle &out) const
+{
+    int n=findFirstNode(root, from, req_size);
+    if(n==-1)
+        return false;
+    out=nodes[n].handle;
+    return true;
+}
+
+
+
+SizeTree::SizeTree()
+{
+    root=-1;
+    seed=2463534242u;
+}
+
+int SizeTree::newNode(mem_size_t size, mem_size_t start, Handle handle)
+{
+    seed^=seed<<13;
+    seed^=seed>>17;
+    seed^=seed<<5;
+
+    Node node;
+    node.size=size;
+    node.start=start;
+    node.priority=seed;
+    node.left=-1;
+    node.right=-1;
+    node.handle=handle;
+
+    if(!freeSlots.empty())
+    {
+        int n=freeSlots.back();
+        freeSlots.pop_back();
+        nodes[n]=node;
+        return n;
+    }
+    nodes.push_back(node);
+    return (int)nodes.size()-1;
+}
+
+
+
+// True if node n orders before (size, start)
+
+bool SizeTree::less(int n, mem_size_t size, mem_size_t start) const
+{
+    if(nodes[n].size!=size)
+        return nodes[n].size<size;
+    return nodes[n].start<start;
+}
+
+void SizeTree::split(int n, mem_size_t size, mem_size_t start, int &left, int &right)
+{
+    if(n==-1)
+    {
+        left=-1;
+        right=-1;
+        return;
+    }
+    if(less(n, size, start))
+    {
+        split(nodes[n].right, size, start, nodes[n].right, right);
+        left=n;
+    }
+    else
+    {
+        split(nodes[n].left, size, start, left, nodes[n].left);
+        right=n;
+    }
+}
+
+int SizeTree::merge(int left, int right)
+{
+    if(left==-1) return right;
+    if(right==-1) return left;
+
+    if(nodes[left].priority>nodes[right].priority)
+    {
+        nodes[left].right=merge(nodes[left].right, right);
+        return left;
+    }
+    nodes[right].left=merge(left, nodes[right].left);
+    return right;
+}
+
+
+
+void SizeTree::insert(mem_size_t size, mem_size_t start, Handle handle)
+{
+    int left, right;
+    split(root, size, start, left, right);
+    root=merge(merge(left, newNode(size, start, handle)), right);
+}
+
+void SizeTree::erase(mem_size_t size, mem_size_t start)
+{
+    int left, middle, right;
+    split(root, size, start, left, middle);
+    split(middle, size, start+1, middle, right);
+    if(middle!=-1)
+        freeSlots.push_back(middle);
+    root=merge(left, right);
+}
+
+
+
+bool SizeTree::lowerBound(mem_size_t req_size, Handle &out) const
+{
+    int best=-1;
+    int n=root;
+    while(n!=-1)
+    {
+        if(nodes[n].size>=req_size)
+        {
+            best=n;
+            n=nodes[n].left;
+        }
+        else
+            n=nodes[n].right;
+    }
+    if(best==-1)
+        return false;
+    out=nodes[best].handle;
+    return true;
+}
+
+
+
+void FreeTree::save(SnapshotWriter &out) const
+{
+    out.putVector(nodes);
+    out.putVector(freeSlots);
+    out.put(root);
+    out.put(seed);
+}
+
+bool FreeTree::load(SnapshotReader &in, uint32_t handles)
+{
+    return in.getVector(nodes) && in.getVector(freeSlots) && in.get(root) && in.get(seed)
+        && validPool(nodes, freeSlots, root, handles);
+}
+
+void SizeTree::save(SnapshotWriter &out) const
+{
+    out.putVector(nodes);
+    out.putVector(freeSlots);
+    out.put(root);
+    out.put(seed);
+}
+
+bool SizeTree::load(SnapshotReader &in, uint32_t handles)
+{
+    return in.getVector(nodes) && in.getVector(freeSlots) && in.get(root) && in.get(seed)
+        && validPool(nodes, freeSlots, root, handles);
+}
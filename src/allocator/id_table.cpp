@@ -0,0 +1,147 @@
+#include "id_table.h"
+
+using namespace std;
+
+IdTable::IdTable()
+{
+    clear();
+}
+
+void IdTable::clear()
+{
+    Entry empty;
+    empty.id=EMPTY;
+    empty.slot=0;
+    table.assign(16, empty);
+    mask=15;
+    count=0;
+}
+
+
+
+// IDs are handed out sequentially, so the low bits alone spread them evenly
+// and keep recently allocated IDs close together in the table
+
+uint32_t IdTable::home(alloc_id_t id) const
+{
+    return (uint32_t)id&mask;
+}
+
+
+
+void IdTable::insert(alloc_id_t id, uint32_t slot)
+{
+    if((count+1)*2>table.size())
+        grow();
+
+    uint32_t i=home(id);
+    while(table[i].id!=EMPTY && table[i].id!=id)
+        i=(i+1)&mask;
+
+    if(table[i].id==EMPTY)
+        count++;
+    table[i].id=id;
+    table[i].slot=slot;
+}
+
+
+
+bool IdTable::find(alloc_id_t id, uint32_t &slot) const
+{
+    uint32_t i=home(id);
+    while(table[i].id!=EMPTY)
+    {
+        if(table[i].id==id)
+        {
+            slot=table[i].slot;
+            return true;
+        }
+        i=(i+1)&mask;
+    }
+    return false;
+}
+
+
+
+// Backward-shift deletion
+// Entries after the hole move back into it unless their home position lies cyclically in (hole, j]
+
+bool IdTable::erase(alloc_id_t id)
+{
+    uint32_t i=home(id);
+    while(table[i].id!=id)
+    {
+        if(table[i].id==EMPTY)
+            return false;
+        i=(i+1)&mask;
+    }
+
+    uint32_t j=i;
+    while(true)
+    {
+        j=(j+1)&mask;
+        if(table[j].id==EMPTY)
+            break;
+        uint32_t k=home(table[j].id);
+        bool stays = (i<=j) ? (i<k && k<=j) : (i<k || k<=j);
+        if(!stays)
+        {
+            table[i]=table[j];
+            i=j;
+        }
+    }
+    table[i].id=EMPTY;
+    count--;
+    return true;
+}
+
+
+
+// Double the capacity and reinsert every entry
+
+void IdTable::grow()
+{
+    vector<Entry> old;
+    old.swap(table);
+
+    Entry empty;
+    empty.id=EMPTY;
+    empty.slot=0;
+    table.assign(old.size()*2, empty);
+    mask=(uint32_t)table.size()-1;
+    count=0;
+
+    for(auto &entry:old)
+        if(entry.id!=EMPTY)
+            insert(entry.id, entry.slot);
+}
+
+
+
+void IdTable::save(SnapshotWriter &out) const
+{
+    out.putVector(table);
+    out.put(mask);
+    out.put(count);
+}
+
+// The count must match the used entries, and staying at most half full guarantees every probe reaches an empty entry
+
+bool IdTable::load(SnapshotReader &in, uint32_t slots)
+{
+    if(!in.getVector(table) || !in.get(mask) || !in.get(count))
+        return false;
+    if(table.size()!=(size_t)mask+1 || (table.size()&(table.size()-1))!=0 || (size_t)count*2>table.size())
+        return false;
+
+    uint32_t used=0;
+    for(auto &entry:table)
+    {
+        if(entry.id==EMPTY)
+            continue;
+        if(entry.id<0 || entry.slot>=slots)
+            return false;
+        used++;
+    }
+    return used==count;
+}
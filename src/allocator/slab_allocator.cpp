@@ -0,0 +1,394 @@
+#include "slab_allocator.h"
+#include <iostream>
+
+using namespace std;
+
+SlabAllocator::SlabAllocator(const vector<int> &classSizes, int slabSize)
+{
+    this->slabSize=slabSize;
+    for(int size:classSizes)
+    {
+        SizeClass c;
+        c.size=size;
+        c.capacity=slabSize/size;
+        c.partialHead=NONE;
+        c.slabs=0;
+        c.emptySlabs=0;
+        c.usedObjects=0;
+        c.requested=0;
+        classes.push_back(c);
+    }
+}
+
+
+
+int SlabAllocator::getSlabSize() const
+{
+    return slabSize;
+}
+
+int SlabAllocator::largestClass() const
+{
+    return classes.back().size;
+}
+
+int SlabAllocator::classFor(int req_size) const
+{
+    int c=0;
+    while(classes[c].size<req_size)
+        c++;
+    return c;
+}
+
+bool SlabAllocator::hasFreeObject(int c) const
+{
+    return classes[c].partialHead!=NONE;
+}
+
+
+
+// Doubly linked list of slabs that still have free objects, one per class
+
+void SlabAllocator::linkPartial(uint32_t s)
+{
+    SizeClass &c=classes[slabs[s].classIndex];
+    slabs[s].prevPartial=NONE;
+    slabs[s].nextPartial=c.partialHead;
+    if(c.partialHead!=NONE)
+        slabs[c.partialHead].prevPartial=s;
+    c.partialHead=s;
+    slabs[s].partial=true;
+}
+
+void SlabAllocator::unlinkPartial(uint32_t s)
+{
+    Slab &slab=slabs[s];
+    if(slab.prevPartial!=NONE)
+        slabs[slab.prevPartial].nextPartial=slab.nextPartial;
+    else
+        classes[slab.classIndex].partialHead=slab.nextPartial;
+    if(slab.nextPartial!=NONE)
+        slabs[slab.nextPartial].prevPartial=slab.prevPartial;
+    slab.partial=false;
+}
+
+
+
+void SlabAllocator::addSlab(int c, mem_size_t start, uint32_t handle)
+{
+    uint32_t s;
+    if(!freeSlabSlots.empty())
+    {
+        s=freeSlabSlots.back();
+        freeSlabSlots.pop_back();
+    }
+    else
+    {
+        s=(uint32_t)slabs.size();
+        slabs.push_back(Slab());
+    }
+
+    Slab &slab=slabs[s];
+    slab.start=start;
+    slab.classIndex=c;
+    slab.used=0;
+    slab.handle=handle;
+    slab.freeObjects.clear();
+    for(int object=classes[c].capacity-1 ; object>=0 ; object--)   // lowest object is handed out first
+        slab.freeObjects.push_back(object);
+    slab.objectIds.assign(classes[c].capacity, -1);
+
+    classes[c].slabs++;
+    classes[c].emptySlabs++;
+    handleToSlab.insert((alloc_id_t)handle, s);
+    linkPartial(s);
+}
+
+
+
+// Pop an object from the first slab with free objects
+// A slab that becomes full leaves the partial list
+
+void SlabAllocator::allocate(alloc_id_t id, int c, int req_size)
+{
+    SizeClass &sizeClass=classes[c];
+    uint32_t s=sizeClass.partialHead;
+    Slab &slab=slabs[s];
+
+    if(slab.used==0)
+        sizeClass.emptySlabs--;
+
+    Allocation allocation;
+    allocation.slab=s;
+    allocation.object=slab.freeObjects.back();
+    allocation.size=req_size;
+    slab.freeObjects.pop_back();
+    slab.objectIds[allocation.object]=id;
+    slab.used++;
+    if(slab.freeObjects.empty())
+        unlinkPartial(s);
+
+    sizeClass.usedObjects++;
+    sizeClass.requested+=req_size;
+
+    uint32_t slot;
+    if(!freeAllocationSlots.empty())
+    {
+        slot=freeAllocationSlots.back();
+        freeAllocationSlots.pop_back();
+        allocations[slot]=allocation;
+    }
+    else
+    {
+        slot=(uint32_t)allocations.size();
+        allocations.push_back(allocation);
+    }
+    idToAllocation.insert(id, slot);
+}
+
+
+
+// Push the object back on its slab
+// A slab that becomes empty is handed back to the Allocator, unless it is the only empty slab of its class
+
+bool SlabAllocator::release(alloc_id_t id, uint32_t &releasedHandle)
+{
+    releasedHandle=NONE;
+
+    uint32_t slot;
+    if(!idToAllocation.find(id, slot))
+        return false;
+    idToAllocation.erase(id);
+    freeAllocationSlots.push_back(slot);
+
+    Allocation &allocation=allocations[slot];
+    uint32_t s=allocation.slab;
+    Slab &slab=slabs[s];
+    SizeClass &sizeClass=classes[slab.classIndex];
+
+    slab.freeObjects.push_back(allocation.object);
+    slab.objectIds[allocation.object]=-1;
+    slab.used--;
+    sizeClass.usedObjects--;
+    sizeClass.requested-=allocation.size;
+    if(!slab.partial)
+        linkPartial(s);
+
+    if(slab.used==0)
+    {
+        if(sizeClass.emptySlabs==0)
+            sizeClass.emptySlabs++;
+        else
+        {
+            unlinkPartial(s);
+            sizeClass.slabs--;
+            handleToSlab.erase((alloc_id_t)slab.handle);
+            freeSlabSlots.push_back(s);
+            releasedHandle=slab.handle;
+        }
+    }
+    return true;
+}
+
+
+
+bool SlabAllocator::requestedSize(alloc_id_t id, mem_size_t &size) const
+{
+    uint32_t slot;
+    if(!idToAllocation.find(id, slot))
+        return false;
+    size=allocations[slot].size;
+    return true;
+}
+
+// The object stays in its class even if a smaller class would now fit
+
+bool SlabAllocator::resize(alloc_id_t id, mem_size_t newSize)
+{
+    uint32_t slot;
+    if(!idToAllocation.find(id, slot))
+        return false;
+    Allocation &allocation=allocations[slot];
+    SizeClass &sizeClass=classes[slabs[allocation.slab].classIndex];
+    if(newSize<=0 || newSize>sizeClass.size)
+        return false;
+    sizeClass.requested+=newSize-allocation.size;
+    allocation.size=(int)newSize;
+    return true;
+}
+
+bool SlabAllocator::rename(alloc_id_t from, alloc_id_t to)
+{
+    uint32_t slot;
+    if(!idToAllocation.find(from, slot))
+        return false;
+    idToAllocation.erase(from);
+    idToAllocation.insert(to, slot);
+    slabs[allocations[slot].slab].objectIds[allocations[slot].object]=to;
+    return true;
+}
+
+
+
+// Object i of a slab lives at start + i * classSize
+
+void SlabAllocator::moveSlab(uint32_t handle, mem_size_t newStart, vector<Relocation> &relocations)
+{
+    uint32_t s;
+    if(!handleToSlab.find((alloc_id_t)handle, s))
+        return;
+    Slab &slab=slabs[s];
+    int size=classes[slab.classIndex].size;
+    for(int object=0 ; object<(int)slab.objectIds.size() ; object++)
+        if(slab.objectIds[object]!=-1)
+            relocations.push_back({slab.objectIds[object], slab.start+(mem_size_t)object*size, newStart+(mem_size_t)object*size});
+    slab.start=newStart;
+}
+
+
+
+bool SlabAllocator::slabInfo(uint32_t handle, int &classSize, int &used, int &capacity) const
+{
+    uint32_t s;
+    if(!handleToSlab.find((alloc_id_t)handle, s))
+        return false;
+    classSize=classes[slabs[s].classIndex].size;
+    used=slabs[s].used;
+    capacity=classes[slabs[s].classIndex].capacity;
+    return true;
+}
+
+
+
+// Internal fragmentation of a class is the rounding loss of its live objects
+
+mem_size_t SlabAllocator::internalFragmentation() const
+{
+    mem_size_t total=0;
+    for(auto &c:classes)
+        total+=(mem_size_t)c.usedObjects*c.size-c.requested;
+    return total;
+}
+
+void SlabAllocator::printStats() const
+{
+    for(auto &c:classes)
+    {
+        int capacity=c.slabs*c.capacity;
+        cout<<"Slab Class "<<c.size<<" : slabs = "<<c.slabs
+            <<", objects = "<<c.usedObjects<<"/"<<capacity
+            <<", occupancy = "<<(capacity>0 ? (double)c.usedObjects/capacity*100 : 0)<<"%"
+            <<", internal fragmentation = "<<(long long)c.usedObjects*c.size-c.requested<<endl;
+    }
+}
+
+
+
+// Slabs hold vectors, so each one is written field by field
+
+void SlabAllocator::save(SnapshotWriter &out) const
+{
+    out.put(slabSize);
+    out.putVector(classes);
+    out.put((uint64_t)slabs.size());
+    for(auto &slab:slabs)
+    {
+        out.put(slab.start);
+        out.put(slab.classIndex);
+        out.put(slab.used);
+        out.put(slab.handle);
+        out.put(slab.prevPartial);
+        out.put(slab.nextPartial);
+        out.put(slab.partial);
+        out.putVector(slab.freeObjects);
+        out.putVector(slab.objectIds);
+    }
+    out.putVector(freeSlabSlots);
+    handleToSlab.save(out);
+    out.putVector(allocations);
+    out.putVector(freeAllocationSlots);
+    idToAllocation.save(out);
+}
+
+bool SlabAllocator::load(SnapshotReader &in, uint32_t handles)
+{
+    uint64_t slabCount;
+    if(!in.get(slabSize) || !in.getVector(classes) || !in.get(slabCount))
+        return false;
+    slabs.clear();
+    for(uint64_t s=0 ; s<slabCount ; s++)
+    {
+        Slab slab;
+        if(!in.get(slab.start) || !in.get(slab.classIndex) || !in.get(slab.used) || !in.get(slab.handle)
+           || !in.get(slab.prevPartial) || !in.get(slab.nextPartial) || !in.get(slab.partial)
+           || !in.getVector(slab.freeObjects) || !in.getVector(slab.objectIds))
+            return false;
+        slabs.push_back(move(slab));
+    }
+    if(!in.getVector(freeSlabSlots) || !handleToSlab.load(in, (uint32_t)slabs.size()) || !in.getVector(allocations)
+       || !in.getVector(freeAllocationSlots) || !idToAllocation.load(in, (uint32_t)allocations.size()))
+        return false;
+
+    if(slabSize<=0 || classes.empty())
+        return false;
+    for(auto &c:classes)
+    {
+        if(c.size<=0 || c.capacity<0 || (c.partialHead!=NONE && c.partialHead>=slabs.size()))
+            return false;
+    }
+
+    // A slab's free objects are distinct objects marked free in objectIds, and with the used ones make up its capacity
+    size_t partial=0;
+    for(auto &slab:slabs)
+    {
+        if(slab.classIndex<0 || slab.classIndex>=(int)classes.size() || slab.handle>=handles
+           || (slab.prevPartial!=NONE && slab.prevPartial>=slabs.size())
+           || (slab.nextPartial!=NONE && slab.nextPartial>=slabs.size()))
+            return false;
+        int capacity=classes[slab.classIndex].capacity;
+        if((int)slab.objectIds.size()!=capacity || slab.used<0 || slab.used+(int)slab.freeObjects.size()!=capacity)
+            return false;
+        vector<bool> listed(capacity, false);
+        for(int object:slab.freeObjects)
+        {
+            if(object<0 || object>=capacity || listed[object] || slab.objectIds[object]!=-1)
+                return false;
+            listed[object]=true;
+        }
+        if(slab.partial)
+            partial++;
+    }
+
+    // The partial lists hold exactly the slabs flagged partial, each in the list of its own class
+    for(int c=0 ; c<(int)classes.size() ; c++)
+    {
+        uint32_t prev=NONE;
+        for(uint32_t s=classes[c].partialHead ; s!=NONE ; s=slabs[s].nextPartial)
+        {
+            if(partial==0 || !slabs[s].partial || slabs[s].classIndex!=c || slabs[s].prevPartial!=prev)
+                return false;
+            partial--;
+            prev=s;
+        }
+    }
+    if(partial!=0)
+        return false;
+
+    for(uint32_t s:freeSlabSlots)
+    {
+        if(s>=slabs.size())
+            return false;
+    }
+    for(auto &allocation:allocations)
+    {
+        if(allocation.slab>=slabs.size() || allocation.object<0
+           || allocation.object>=(int)slabs[allocation.slab].objectIds.size())
+            return false;
+    }
+    for(uint32_t slot:freeAllocationSlots)
+    {
+        if(slot>=allocations.size())
+            return false;
+    }
+    return true;
+}
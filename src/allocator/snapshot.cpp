@@ -0,0 +1,125 @@
+#include "snapshot.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char SNAPSHOT_MAGIC[8]={'M', 'S', 'S', 'N', 'A', 'P', 0, 3};
+
+static const size_t BUFFER_SIZE=1<<20;
+
+SnapshotWriter::SnapshotWriter()
+{
+    file=nullptr;
+    ok=false;
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    close();
+}
+
+bool SnapshotWriter::open(const char *path)
+{
+    file=fopen(path, "wb");
+    ok=file!=nullptr;
+    buffer.reserve(BUFFER_SIZE);
+    if(ok)
+        putBytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    return ok;
+}
+
+bool SnapshotWriter::close()
+{
+    if(!file)
+        return ok;
+    flush();
+    if(fclose(file)!=0)
+        ok=false;
+    file=nullptr;
+    return ok;
+}
+
+void SnapshotWriter::flush()
+{
+    if(!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file)!=buffer.size())
+        ok=false;
+    buffer.clear();
+}
+
+// Large arrays bypass the buffer
+
+void SnapshotWriter::putBytes(const void *bytes, size_t length)
+{
+    if(!file)
+        return;
+    if(buffer.size()+length>BUFFER_SIZE)
+        flush();
+    if(length>=BUFFER_SIZE)
+    {
+        if(fwrite(bytes, 1, length, file)!=length)
+            ok=false;
+        return;
+    }
+    buffer.insert(buffer.end(), (const char*)bytes, (const char*)bytes+length);
+}
+
+
+
+SnapshotReader::SnapshotReader()
+{
+    data=nullptr;
+    pos=nullptr;
+    end=nullptr;
+    mappedLength=0;
+}
+
+SnapshotReader::~SnapshotReader()
+{
+    if(mappedLength>0)
+        munmap((void*)data, mappedLength);
+}
+
+bool SnapshotReader::open(const char *path)
+{
+    int fd=::open(path, O_RDONLY);
+    if(fd<0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st)<0 || st.st_size<(off_t)sizeof(SNAPSHOT_MAGIC))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapped=mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped==MAP_FAILED)
+        return false;
+    madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+    data=(const char*)mapped;
+    mappedLength=st.st_size;
+    pos=data;
+    end=data+mappedLength;
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    return getBytes(magic, sizeof(magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic))==0;
+}
+
+bool SnapshotReader::getBytes(void *bytes, size_t length)
+{
+    if(length>(size_t)(end-pos))
+        return false;
+    if(length>0)
+        memcpy(bytes, pos, length);
+    pos+=length;
+    return true;
+}
+
+bool SnapshotReader::atEnd() const
+{
+    return pos==end;
+}
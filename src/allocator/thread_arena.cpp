@@ -0,0 +1,282 @@
+#include "thread_arena.h"
+
+using namespace std;
+
+SharedHeap::SharedHeap(mem_size_t totalSize, mem_size_t chunkSize)
+{
+    this->chunkSize=chunkSize;
+    chunkCount=(uint32_t)min<mem_size_t>(totalSize/chunkSize, NONE-1);
+    bump=0;
+    freeHead=NONE;
+    freeNext.reset(new atomic<uint32_t>[chunkCount]);
+    retries=0;
+    inUse=0;
+    peakInUse=0;
+}
+
+
+
+// Pop a returned chunk, or take a fresh one from the bump index once the stack is empty
+// The tag in the high half of freeHead changes on every push and pop, so a chunk that was popped
+// and pushed again between the load and the compare-and-swap cannot be mistaken for the old top (ABA)
+
+bool SharedHeap::acquire(uint32_t &chunk)
+{
+    uint64_t head=freeHead.load(memory_order_acquire);
+    while((uint32_t)head!=NONE)
+    {
+        uint32_t top=(uint32_t)head;
+        uint64_t next=((head>>32)+1)<<32 | freeNext[top].load(memory_order_relaxed);
+        if(freeHead.compare_exchange_weak(head, next, memory_order_acq_rel, memory_order_acquire))
+        {
+            chunk=top;
+            taken();
+            return true;
+        }
+        retries.fetch_add(1, memory_order_relaxed);
+    }
+
+    uint32_t fresh=bump.load(memory_order_relaxed);
+    while(fresh<chunkCount)
+    {
+        if(bump.compare_exchange_weak(fresh, fresh+1, memory_order_relaxed))
+        {
+            chunk=fresh;
+            taken();
+            return true;
+        }
+        retries.fetch_add(1, memory_order_relaxed);
+    }
+    return false;
+}
+
+void SharedHeap::release(uint32_t chunk)
+{
+    uint64_t head=freeHead.load(memory_order_relaxed);
+    while(true)
+    {
+        freeNext[chunk].store((uint32_t)head, memory_order_relaxed);
+        uint64_t next=((head>>32)+1)<<32 | chunk;
+        if(freeHead.compare_exchange_weak(head, next, memory_order_release, memory_order_relaxed))
+            break;
+        retries.fetch_add(1, memory_order_relaxed);
+    }
+    inUse.fetch_sub(1, memory_order_relaxed);
+}
+
+void SharedHeap::taken()
+{
+    uint32_t now=inUse.fetch_add(1, memory_order_relaxed)+1;
+    uint32_t peak=peakInUse.load(memory_order_relaxed);
+    while(peak<now && !peakInUse.compare_exchange_weak(peak, now, memory_order_relaxed))
+        ;
+}
+
+
+
+mem_size_t SharedHeap::getChunkSize() const
+{
+    return chunkSize;
+}
+
+uint32_t SharedHeap::getChunkCount() const
+{
+    return chunkCount;
+}
+
+int64_t SharedHeap::casRetries() const
+{
+    return retries.load(memory_order_relaxed);
+}
+
+uint32_t SharedHeap::chunksInUse() const
+{
+    return inUse.load(memory_order_relaxed);
+}
+
+uint32_t SharedHeap::peakChunksInUse() const
+{
+    return peakInUse.load(memory_order_relaxed);
+}
+
+
+
+ThreadArena::ThreadArena(SharedHeap &shared) : shared(shared)
+{
+    current=SharedHeap::NONE;
+    heldChunks=0;
+    nextId=1;
+    counters=ArenaStats();
+}
+
+
+
+// The chunk that served the last request is tried first, then every other chunk held, then a refill
+// Chunks too fragmented for the request are skipped on their largest free block without calling the Allocator
+
+bool ThreadArena::place(AllocationStrategy strategy, mem_size_t size, mem_size_t alignment, uint32_t &slot, alloc_id_t &localId)
+{
+    if(size<=0 || size>shared.getChunkSize() || (alignment!=0 && !Allocator::validAlignment(alignment)))
+        return false;
+
+    if(current!=SharedHeap::NONE)
+    {
+        localId=chunks[current].heap->allocate(strategy, size, alignment);
+        if(localId!=-1)
+        {
+            slot=current;
+            return true;
+        }
+    }
+    for(uint32_t s=0 ; s<chunks.size() ; s++)
+    {
+        if(s==current || !chunks[s].heap || chunks[s].heap->getStats().largestFreeBlock<size)
+            continue;
+        localId=chunks[s].heap->allocate(strategy, size, alignment);
+        if(localId!=-1)
+        {
+            slot=current=s;
+            return true;
+        }
+    }
+
+    uint32_t index;
+    if(!shared.acquire(index))
+        return false;
+    if(!freeChunkSlots.empty())
+    {
+        slot=freeChunkSlots.back();
+        freeChunkSlots.pop_back();
+    }
+    else
+    {
+        slot=(uint32_t)chunks.size();
+        chunks.push_back(Chunk());
+    }
+    chunks[slot].index=index;
+    chunks[slot].heap.reset(new Allocator(shared.getChunkSize()));
+    current=slot;
+    counters.refills++;
+    heldChunks++;
+    counters.peakChunks=max(counters.peakChunks, heldChunks);
+
+    localId=chunks[slot].heap->allocate(strategy, size, alignment);
+    return localId!=-1;
+}
+
+alloc_id_t ThreadArena::allocate(AllocationStrategy strategy, mem_size_t size, mem_size_t alignment)
+{
+    counters.allocRequests++;
+    uint32_t slot;
+    alloc_id_t localId;
+    if(!place(strategy, size, alignment, slot, localId))
+    {
+        counters.allocFailures++;
+        return -1;
+    }
+
+    Allocation allocation;
+    allocation.slot=slot;
+    allocation.alignLog2=alignment>0 ? (uint8_t)__builtin_ctzll((uint64_t)alignment) : 0;
+    allocation.localId=localId;
+    uint32_t a;
+    if(!freeAllocationSlots.empty())
+    {
+        a=freeAllocationSlots.back();
+        freeAllocationSlots.pop_back();
+        allocations[a]=allocation;
+    }
+    else
+    {
+        a=(uint32_t)allocations.size();
+        allocations.push_back(allocation);
+    }
+    idToAllocation.insert(nextId, a);
+    return nextId++;
+}
+
+
+
+bool ThreadArena::freeBlock(alloc_id_t id)
+{
+    uint32_t a;
+    if(!idToAllocation.find(id, a))
+    {
+        counters.invalidFrees++;
+        return false;
+    }
+    idToAllocation.erase(id);
+    freeAllocationSlots.push_back(a);
+
+    uint32_t slot=allocations[a].slot;
+    chunks[slot].heap->freeBlock(allocations[a].localId);
+    counters.frees++;
+    returnIfEmpty(slot);
+    return true;
+}
+
+// An empty chunk still counts its buddy pool and kept slabs as used, so those chunks stay with the arena
+
+void ThreadArena::returnIfEmpty(uint32_t slot)
+{
+    if(heldChunks<=1 || chunks[slot].heap->getStats().usedBytes>0)
+        return;
+
+    shared.release(chunks[slot].index);
+    chunks[slot].heap.reset();
+    freeChunkSlots.push_back(slot);
+    if(current==slot)
+        current=SharedHeap::NONE;
+    heldChunks--;
+    counters.chunksReturned++;
+}
+
+
+
+bool ThreadArena::reallocate(alloc_id_t id, mem_size_t newSize, AllocationStrategy strategy)
+{
+    uint32_t a;
+    if(!idToAllocation.find(id, a))
+        return false;
+
+    Allocation &allocation=allocations[a];
+    if(chunks[allocation.slot].heap->reallocate(allocation.localId, newSize, strategy))
+    {
+        counters.reallocs++;
+        return true;
+    }
+
+    uint32_t slot;
+    alloc_id_t localId;
+    if(!place(strategy, newSize, (mem_size_t)1<<allocation.alignLog2, slot, localId))
+        return false;
+
+    uint32_t old_slot=allocation.slot;
+    chunks[old_slot].heap->freeBlock(allocation.localId);
+    allocation.slot=slot;
+    allocation.localId=localId;
+    counters.reallocs++;
+    returnIfEmpty(old_slot);
+    return true;
+}
+
+
+
+ArenaStats ThreadArena::getStats() const
+{
+    ArenaStats stats=counters;
+    stats.chunks=heldChunks;
+    stats.usedBytes=0;
+    stats.freeBytes=0;
+    stats.largestFreeBlock=0;
+    for(auto &chunk:chunks)
+    {
+        if(!chunk.heap)
+            continue;
+        AllocatorStats chunkStats=chunk.heap->getStats();
+        stats.usedBytes+=chunkStats.usedBytes;
+        stats.freeBytes+=chunkStats.freeBytes;
+        stats.largestFreeBlock=max(stats.largestFreeBlock, chunkStats.largestFreeBlock);
+    }
+    return stats;
+}
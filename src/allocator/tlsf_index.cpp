@@ -0,0 +1,157 @@
+#include "tlsf_index.h"
+
+using namespace std;
+
+TlsfIndex::TlsfIndex()
+{
+    flBitmap=0;
+    for(int fl=0 ; fl<FL_COUNT ; fl++)
+    {
+        slBitmap[fl]=0;
+        for(int sl=0 ; sl<SL_COUNT ; sl++)
+            heads[fl][sl]=NONE;
+    }
+}
+
+
+
+// Sizes below SL_COUNT share first level 0, one bin per size
+// Otherwise fl is set by the highest bit, and sl by the SL_BITS bits below it
+
+void TlsfIndex::mapping(mem_size_t size, int &fl, int &sl)
+{
+    if(size<SL_COUNT)
+    {
+        fl=0;
+        sl=(int)size;
+        return;
+    }
+    int msb=63-__builtin_clzll((uint64_t)size);
+    fl=msb-SL_BITS+1;
+    sl=(int)(size>>(msb-SL_BITS))-SL_COUNT;
+}
+
+
+
+// Push the block at the head of its bin and mark the bin as non-empty
+
+void TlsfIndex::insert(uint32_t handle, mem_size_t size)
+{
+    if(handle>=prevLink.size())
+    {
+        prevLink.resize(handle+1, NONE);
+        nextLink.resize(handle+1, NONE);
+    }
+
+    int fl, sl;
+    mapping(size, fl, sl);
+
+    prevLink[handle]=NONE;
+    nextLink[handle]=heads[fl][sl];
+    if(heads[fl][sl]!=NONE)
+        prevLink[heads[fl][sl]]=handle;
+    heads[fl][sl]=handle;
+
+    slBitmap[fl] |= 1u<<sl;
+    flBitmap |= (uint64_t)1<<fl;
+}
+
+
+
+void TlsfIndex::erase(uint32_t handle, mem_size_t size)
+{
+    int fl, sl;
+    mapping(size, fl, sl);
+
+    uint32_t prev=prevLink[handle];
+    uint32_t next=nextLink[handle];
+    if(prev!=NONE)
+        nextLink[prev]=next;
+    else
+        heads[fl][sl]=next;
+    if(next!=NONE)
+        prevLink[next]=prev;
+
+    if(heads[fl][sl]==NONE)
+    {
+        slBitmap[fl] &= ~(1u<<sl);
+        if(slBitmap[fl]==0)
+            flBitmap &= ~((uint64_t)1<<fl);
+    }
+}
+
+
+
+// Round req_size up to the next bin boundary, so any block of the bin found is large enough
+// Look for a non-empty bin at or above it in the same first level, then in the next non-empty first level
+
+bool TlsfIndex::find(mem_size_t req_size, uint32_t &out) const
+{
+    mem_size_t rounded=req_size;
+    if(req_size>=SL_COUNT)
+    {
+        int msb=63-__builtin_clzll((uint64_t)req_size);
+        mem_size_t step=((mem_size_t)1<<(msb-SL_BITS))-1;
+        if(rounded>INT64_MAX-step)
+            return false;
+        rounded+=step;
+    }
+
+    int fl, sl;
+    mapping(rounded, fl, sl);
+
+    uint32_t sl_map=slBitmap[fl] & (~0u<<sl);
+    if(sl_map==0)
+    {
+        uint64_t fl_map=(fl+1<FL_COUNT) ? (flBitmap & (~(uint64_t)0<<(fl+1))) : 0;
+        if(fl_map==0)
+            return false;
+        fl=__builtin_ctzll(fl_map);
+        sl_map=slBitmap[fl];
+    }
+    sl=__builtin_ctz(sl_map);
+
+    out=heads[fl][sl];
+    return true;
+}
+
+
+
+void TlsfIndex::save(SnapshotWriter &out) const
+{
+    out.put(flBitmap);
+    out.put(slBitmap);
+    out.put(heads);
+    out.putVector(prevLink);
+    out.putVector(nextLink);
+}
+
+// find() scans the bitmaps without looking at the bins, so a bit must be set exactly when its bin or level is non-empty
+
+bool TlsfIndex::load(SnapshotReader &in, uint32_t handles)
+{
+    if(!in.get(flBitmap) || !in.get(slBitmap) || !in.get(heads) || !in.getVector(prevLink) || !in.getVector(nextLink)
+       || prevLink.size()!=nextLink.size())
+        return false;
+
+    vector<bool> seen(prevLink.size(), false);
+    for(int fl=0 ; fl<FL_COUNT ; fl++)
+    {
+        for(int sl=0 ; sl<SL_COUNT ; sl++)
+        {
+            uint32_t prev=NONE;
+            for(uint32_t h=heads[fl][sl] ; h!=NONE ; h=nextLink[h])
+            {
+                if(h>=handles || h>=prevLink.size() || seen[h] || prevLink[h]!=prev)
+                    return false;
+                seen[h]=true;
+                prev=h;
+            }
+            if(((slBitmap[fl]>>sl)&1)!=(heads[fl][sl]!=NONE))
+                return false;
+        }
+        if((slBitmap[fl]>>SL_COUNT)!=0 || ((flBitmap>>fl)&1)!=(slBitmap[fl]!=0))
+            return false;
+    }
+    return (flBitmap>>FL_COUNT)==0;
+}
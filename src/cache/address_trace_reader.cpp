@@ -0,0 +1,376 @@
+#include "address_trace.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char ADDRESS_TRACE_FIXED_MAGIC[8]={'C', 'S', 'T', 'R', 'A', 'C', 'E', 1};
+const char ADDRESS_TRACE_DELTA_MAGIC[8]={'C', 'S', 'T', 'R', 'A', 'C', 'E', 2};
+
+static const uint64_t ADDRESS_MASK=(1ULL<<62)-1;
+static const size_t STREAM_BUFFER_SIZE=1<<22;
+
+AddressTraceReader::AddressTraceReader()
+{
+    fd=-1;
+    data=nullptr;
+    pos=nullptr;
+    end=nullptr;
+    mappedLength=0;
+    format=ADDRESS_TEXT;
+    previous=0;
+    line=0;
+}
+
+AddressTraceReader::~AddressTraceReader()
+{
+    if(mappedLength>0)
+        munmap((void*)data, mappedLength);
+    if(fd>0)
+        close(fd);
+}
+
+
+
+// Regular files are mapped read-only and parsed in place
+// Anything else, stdin included, is read through a fixed window that fill() slides along the input
+
+bool AddressTraceReader::open(const char *path)
+{
+    if(strcmp(path, "-")==0)
+        fd=0;
+    else
+    {
+        fd=::open(path, O_RDONLY);
+        if(fd<0)
+            return fail(string("cannot open ")+path);
+
+        struct stat st;
+        if(fstat(fd, &st)<0)
+        {
+            close(fd);
+            fd=-1;
+            return fail(string("cannot stat ")+path);
+        }
+
+        if(S_ISREG(st.st_mode))
+        {
+            if(st.st_size>0)
+            {
+                void *mapped=mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapped==MAP_FAILED)
+                {
+                    close(fd);
+                    fd=-1;
+                    return fail(string("cannot map ")+path);
+                }
+                madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+                data=(const char*)mapped;
+                mappedLength=st.st_size;
+            }
+            close(fd);
+            fd=-1;
+        }
+    }
+
+    if(fd>=0)
+    {
+        buffer.resize(STREAM_BUFFER_SIZE);
+        data=buffer.data();
+        end=data;
+    }
+    else
+        end=data+mappedLength;
+    pos=data;
+
+    fill(sizeof(ADDRESS_TRACE_FIXED_MAGIC));
+    if(failed())
+        return false;
+    if(end-pos>=(ptrdiff_t)sizeof(ADDRESS_TRACE_FIXED_MAGIC))
+    {
+        if(memcmp(pos, ADDRESS_TRACE_FIXED_MAGIC, sizeof(ADDRESS_TRACE_FIXED_MAGIC))==0)
+            format=ADDRESS_FIXED;
+        else if(memcmp(pos, ADDRESS_TRACE_DELTA_MAGIC, sizeof(ADDRESS_TRACE_DELTA_MAGIC))==0)
+            format=ADDRESS_DELTA;
+        if(format!=ADDRESS_TEXT)
+            pos+=sizeof(ADDRESS_TRACE_FIXED_MAGIC);
+    }
+    return true;
+}
+
+// Make at least `needed` bytes available at pos, moving the unread rest of a streamed window to its front
+// and reading more input behind it; false if the input ends first
+
+bool AddressTraceReader::fill(size_t needed)
+{
+    while((size_t)(end-pos)<needed && fd>=0)
+    {
+        size_t left=end-pos;
+        memmove(buffer.data(), pos, left);
+        pos=buffer.data();
+        end=pos+left;
+
+        ssize_t n=::read(fd, buffer.data()+left, buffer.size()-left);
+        if(n<0 && errno==EINTR)
+            continue;
+        if(n<=0)
+        {
+            if(fd>0)
+                close(fd);
+            fd=-1;
+            if(n<0)
+                return fail("cannot read input");
+            break;
+        }
+        end+=n;
+    }
+    return (size_t)(end-pos)>=needed;
+}
+
+bool AddressTraceReader::fail(const string &message)
+{
+    if(errorMessage.empty())
+        errorMessage=line>0 ? (format==ADDRESS_TEXT ? "line " : "record ")+to_string(line)+": "+message : message;
+    if(fd>0)
+        close(fd);
+    fd=-1;
+    pos=end;
+    return false;
+}
+
+
+
+size_t AddressTraceReader::read(AddressAccess *records, size_t count)
+{
+    size_t n=0;
+    if(format==ADDRESS_FIXED)
+    {
+        while(n<count && nextFixed(records[n]))
+            n++;
+    }
+    else if(format==ADDRESS_DELTA)
+    {
+        while(n<count && nextDelta(records[n]))
+            n++;
+    }
+    else
+    {
+        // An M record needs room for two accesses
+        const char *start, *stop;
+        while(n+2<=count && nextLine(start, stop))
+        {
+            int parsed=parseLine(start, stop, records+n);
+            if(parsed<0)
+                break;
+            n+=parsed;
+        }
+    }
+    return n;
+}
+
+
+
+// Text lines are found with memchr; a line cut off by the end of a streamed window is read again once it has been refilled
+
+bool AddressTraceReader::nextLine(const char *&start, const char *&stop)
+{
+    while(true)
+    {
+        const char *newline=pos<end ? (const char*)memchr(pos, '\n', end-pos) : nullptr;
+        if(newline)
+        {
+            start=pos;
+            stop=newline;
+            pos=newline+1;
+            line++;
+            return true;
+        }
+        if(fd<0)
+        {
+            if(pos==end)
+                return false;
+            start=pos;
+            stop=end;
+            pos=end;
+            line++;
+            return true;
+        }
+
+        size_t have=end-pos;
+        if(have==buffer.size())
+            return fail("line is too long");
+        fill(have+1);
+        if(failed())
+            return false;
+    }
+}
+
+static int hexDigit(char c)
+{
+    if(c>='0' && c<='9') return c-'0';
+    if(c>='a' && c<='f') return c-'a'+10;
+    if(c>='A' && c<='F') return c-'A'+10;
+    return -1;
+}
+
+// Returns the accesses the line holds (0 for a skipped line, 2 for an M record), -1 on a parse error
+
+int AddressTraceReader::parseLine(const char *start, const char *stop, AddressAccess *records)
+{
+    while(start<stop && (*start==' ' || *start=='\t'))
+        start++;
+    while(stop>start && (stop[-1]=='\r' || stop[-1]==' ' || stop[-1]=='\t'))
+        stop--;
+    if(start==stop || *start=='#' || *start=='=' || *start=='-')
+        return 0;
+
+    // Lackey records start with their kind, which is never a hex digit
+    AccessType type=READ;
+    bool lackey=false, modify=false;
+    char kind=*start;
+    if(stop-start>1 && (start[1]==' ' || start[1]=='\t') && (kind=='I' || kind=='L' || kind=='S' || kind=='M'))
+    {
+        lackey=true;
+        modify=kind=='M';
+        type=kind=='I' ? INSTRUCTION_FETCH : kind=='S' ? WRITE : READ;
+        start+=2;
+        while(start<stop && (*start==' ' || *start=='\t'))
+            start++;
+    }
+
+    if(stop-start>2 && start[0]=='0' && (start[1]=='x' || start[1]=='X'))
+        start+=2;
+    uint64_t address=0;
+    int digits=0;
+    for( ; start<stop && hexDigit(*start)>=0 ; start++, digits++)
+    {
+        if(digits==16)
+        {
+            fail("address is too long");
+            return -1;
+        }
+        address=address<<4 | hexDigit(*start);
+    }
+    if(digits==0)
+    {
+        fail("bad address "+string(start, stop-start));
+        return -1;
+    }
+    // The binary formats keep 62 address bits, so a wider address could not be converted without changing it
+    if(address>ADDRESS_MASK)
+    {
+        fail("address is above bit 61");
+        return -1;
+    }
+
+    uint32_t size=0;
+    if(lackey)
+    {
+        if(start>=stop || *start!=',' || start+1>=stop)
+        {
+            fail("lackey record needs a size");
+            return -1;
+        }
+        for(start++ ; start<stop && *start>='0' && *start<='9' ; start++)
+        {
+            if(size>(1u<<20))
+            {
+                fail("access size is too large");
+                return -1;
+            }
+            size=size*10+(*start-'0');
+        }
+    }
+    if(start!=stop)
+    {
+        fail("unexpected text "+string(start, stop-start));
+        return -1;
+    }
+
+    records[0]={address, size, type};
+    if(!modify)
+        return 1;
+    records[1]={address, size, WRITE};
+    return 2;
+}
+
+
+
+// Binary records, see ADDRESS_TRACE_FIXED_MAGIC; both are decoded byte by byte so the host's byte order does not matter
+
+bool AddressTraceReader::nextFixed(AddressAccess &record)
+{
+    if(!fill(8))
+    {
+        if(pos!=end)
+            fail("truncated record");
+        return false;
+    }
+    line++;
+
+    uint64_t value=0;
+    for(int i=0 ; i<8 ; i++)
+        value|=(uint64_t)(uint8_t)pos[i]<<(8*i);
+    pos+=8;
+
+    int type=value>>62;
+    if(type>INSTRUCTION_FETCH)
+        return fail("bad access type");
+    record.address=value&ADDRESS_MASK;
+    record.size=0;
+    record.type=(AccessType)type;
+    return true;
+}
+
+bool AddressTraceReader::nextDelta(AddressAccess &record)
+{
+    if(!fill(10) && pos==end)   // a varint takes at most 10 bytes, fewer are fine at the end of the trace
+        return false;
+    line++;
+
+    uint64_t raw=0;
+    for(int shift=0 ; ; shift+=7)
+    {
+        if(pos>=end)
+            return fail("truncated record");
+        if(shift>63)
+            return fail("bad varint");
+        uint8_t byte=(uint8_t)*pos++;
+        raw|=(uint64_t)(byte&0x7F)<<shift;
+        if(!(byte&0x80))
+            break;
+    }
+
+    int type=raw&3;
+    if(type>INSTRUCTION_FETCH)
+        return fail("bad access type");
+    uint64_t zigzag=raw>>2;
+    int64_t delta=(int64_t)(zigzag>>1)^-(int64_t)(zigzag&1);
+    previous=(previous+delta)&ADDRESS_MASK;
+
+    record.address=previous;
+    record.size=0;
+    record.type=(AccessType)type;
+    return true;
+}
+
+
+
+AddressTraceFormat AddressTraceReader::getFormat() const
+{
+    return format;
+}
+
+bool AddressTraceReader::failed() const
+{
+    return !errorMessage.empty();
+}
+
+const string &AddressTraceReader::error() const
+{
+    return errorMessage;
+}
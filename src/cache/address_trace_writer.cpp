@@ -0,0 +1,85 @@
+#include "address_trace.h"
+#include <cstring>
+
+using namespace std;
+
+static const uint64_t ADDRESS_MASK=(1ULL<<62)-1;
+static const size_t WRITE_BUFFER_SIZE=1<<20;
+
+AddressTraceWriter::AddressTraceWriter()
+{
+    file=nullptr;
+    format=ADDRESS_DELTA;
+    ok=true;
+    previous=0;
+}
+
+AddressTraceWriter::~AddressTraceWriter()
+{
+    close();
+}
+
+bool AddressTraceWriter::open(const char *path, AddressTraceFormat format)
+{
+    if(format==ADDRESS_TEXT)
+        return false;
+    this->format=format;
+    file=strcmp(path, "-")==0 ? stdout : fopen(path, "wb");
+    if(!file)
+        return false;
+
+    buffer.reserve(WRITE_BUFFER_SIZE+16);
+    const char *magic=format==ADDRESS_FIXED ? ADDRESS_TRACE_FIXED_MAGIC : ADDRESS_TRACE_DELTA_MAGIC;
+    buffer.insert(buffer.end(), magic, magic+sizeof(ADDRESS_TRACE_FIXED_MAGIC));
+    return true;
+}
+
+bool AddressTraceWriter::close()
+{
+    if(!file)
+        return ok;
+    flush();
+    if(file==stdout)
+        ok=fflush(stdout)==0 && ok;
+    else
+        ok=fclose(file)==0 && ok;
+    file=nullptr;
+    return ok;
+}
+
+
+
+// Deltas are taken modulo 2^62 and sign extended from bit 61, so the zigzag value leaves two bits for the type
+
+void AddressTraceWriter::write(uint64_t address, AccessType type)
+{
+    address&=ADDRESS_MASK;
+    if(format==ADDRESS_FIXED)
+    {
+        uint64_t value=address | (uint64_t)type<<62;
+        for(int i=0 ; i<8 ; i++)
+            buffer.push_back((char)(value>>(8*i)));
+    }
+    else
+    {
+        int64_t delta=(int64_t)(((address-previous)&ADDRESS_MASK)<<2)>>2;
+        uint64_t raw=((uint64_t)(delta*2) ^ (uint64_t)(delta>>63))<<2 | (uint64_t)type;
+        while(raw>=0x80)
+        {
+            buffer.push_back((char)(raw|0x80));
+            raw>>=7;
+        }
+        buffer.push_back((char)raw);
+        previous=address;
+    }
+
+    if(buffer.size()>=WRITE_BUFFER_SIZE)
+        flush();
+}
+
+void AddressTraceWriter::flush()
+{
+    if(!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file)!=buffer.size())
+        ok=false;
+    buffer.clear();
+}
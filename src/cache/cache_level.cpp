@@ -3,41 +3,92 @@
 
 using namespace std;
 
-CacheLevel::CacheLevel(int cacheSize, int blockSize, int associativity, ReplacementPolicy policy)
+CacheLevel::CacheLevel(int cacheSize, int blockSize, int associativity, ReplacementPolicy policy, InclusionPolicy inclusion,
+                       WritePolicy writePolicy)
 {
     this->cacheSize=cacheSize;
     this->blockSize=blockSize;
     this->associativity=associativity;
     this->policy=policy;
+    this->inclusion=inclusion;
+    this->writePolicy=writePolicy;
 
     this->numSets=cacheSize/(blockSize*associativity); // Number of sets in cache level
 
-    sets.resize(numSets); 
+    // Power-of-two block sizes and set counts are split off with a shift and a mask
+    blockShift=-1;
+    if(blockSize>0 && (blockSize & (blockSize-1))==0)
+    {
+        blockShift=0;
+        while((1<<blockShift)<blockSize)
+            blockShift++;
+    }
+    setMask=numSets>0 && (numSets & (numSets-1))==0 ? numSets-1 : -1;
+
+    tags.assign((size_t)max(numSets, 0)*max(associativity, 0), (int)EMPTY_LINE);
+    highTags.assign(tags.size(), EMPTY_LINE>>32);
+    lineFlags.assign(tags.size(), 0);
+    findTag=bestTagLookup();
+    occupied.assign(max(numSets, 0), 0);
+
+    int sets=max(numSets, 0);
+    int ways=max(associativity, 0);
+    switch(policy)
+    {
+        case FIFO:      replacement=FifoPolicy(sets, ways); break;
+        case LRU:       replacement=LruPolicy(sets, ways); break;
+        case TREE_PLRU: replacement=TreePlruPolicy(sets, ways); break;
+        case SRRIP:     replacement=SrripPolicy(sets, ways); break;
+        case BRRIP:     replacement=BrripPolicy(sets, ways); break;
+        case LFU:       replacement=LfuPolicy(sets, ways); break;
+        case RANDOM:    replacement=RandomPolicy(sets, ways); break;
+    }
 
     hits=0;
     misses=0;
 }
 
 
-bool CacheLevel::access(int req_block_address)
+bool CacheLevel::access(uint64_t req_block_address)
+{
+    return visit([&](auto &policy) { return accessWith(policy, req_block_address); }, replacement);
+}
+
+bool CacheLevel::insert(uint64_t block_address, uint64_t *evicted_address, bool *evicted_dirty)
+{
+    return visit([&](auto &policy) { return insertWith(policy, block_address, evicted_address, evicted_dirty); }, replacement);
+}
+
+bool CacheLevel::remove(uint64_t req_block_address)
+{
+    return visit([&](auto &policy) { return removeWith(policy, req_block_address); }, replacement);
+}
+
+void CacheLevel::markDirty(uint64_t block_address)
+{
+    int set_number=setOf(block_address);
+    int way=find(set_number, block_address);
+    if(way!=-1)
+        lineFlags[(size_t)set_number*associativity+way]|=LINE_DIRTY;
+}
+
+bool CacheLevel::contains(uint64_t block_address) const
 {
-    int set_number=req_block_address % numSets;
+    return find(setOf(block_address), block_address)!=-1;
+}
+
 
-    deque<int> &set=sets[set_number];
+template<class Policy>
+bool CacheLevel::accessWith(Policy &policy, uint64_t req_block_address)
+{
+    int set_number=setOf(req_block_address);
 
-    for(auto it=set.begin() ; it!=set.end() ; it++)
+    int way=find(set_number, req_block_address);
+    if(way!=-1)
     {
-        int block_address=*it;
-        if(req_block_address==block_address)
-        {
-            if(policy==LRU)
-            {
-                set.erase(it);
-                set.push_back(block_address);
-            }
-            hits++;
-            return true;
-        }
+        policy.hit(set_number, way);
+        hits++;
+        return true;
     }
 
     misses++;   // If tag is not present in set
@@ -45,47 +96,60 @@ bool CacheLevel::access(int req_block_address)
     return false;
 }
 
-int CacheLevel::insert(int block_address)
+template<class Policy>
+bool CacheLevel::insertWith(Policy &policy, uint64_t block_address, uint64_t *evicted_address, bool *evicted_dirty)
 {
-    int set_number=block_address % numSets;
-
-    deque<int> &set=sets[set_number];
+    int set_number=setOf(block_address);
+    size_t first=(size_t)set_number*associativity;
 
-    if(set.size()<associativity)
+    if(occupied[set_number]<associativity)
     {
-        set.push_back(block_address);
-        return -1;
+        int way=find(set_number, EMPTY_LINE, false);
+        tags[first+way]=(int)(uint32_t)block_address;
+        highTags[first+way]=block_address>>32;
+        lineFlags[first+way]=LINE_VALID;
+        policy.insert(set_number, way);
+        occupied[set_number]++;
+        return false;
     }
 
-    int evicted_address=set.front();
-    set.pop_front();
-    set.push_back(block_address);
-    return evicted_address;
+    // Set is full: the policy's victim is replaced
+    int way=policy.victim(set_number);
+    if(evicted_address) *evicted_address=(uint64_t)highTags[first+way]<<32 | (uint32_t)tags[first+way];
+    if(evicted_dirty) *evicted_dirty=(lineFlags[first+way]&LINE_DIRTY)!=0;
+    policy.remove(set_number, way);
+    tags[first+way]=(int)(uint32_t)block_address;
+    highTags[first+way]=block_address>>32;
+    lineFlags[first+way]=LINE_VALID;
+    policy.insert(set_number, way);
+    return true;
 }
 
-void CacheLevel::remove(int req_block_address)
+template<class Policy>
+bool CacheLevel::removeWith(Policy &policy, uint64_t req_block_address)
 {
-    int set_number=req_block_address % numSets;
-
-    deque<int> &set=sets[set_number];
-
-    for(auto it=set.begin() ; it!=set.end() ; it++)
-    {
-        int block_address=*it;
-        if(block_address==req_block_address)
-        {
-            set.erase(it);
-            return;
-        }
-    }
+    int set_number=setOf(req_block_address);
+
+    int way=find(set_number, req_block_address);
+    if(way==-1)
+        return false;
+
+    size_t line=(size_t)set_number*associativity+way;
+    bool was_dirty=(lineFlags[line]&LINE_DIRTY)!=0;
+    tags[line]=(int)EMPTY_LINE;
+    highTags[line]=EMPTY_LINE>>32;
+    lineFlags[line]=0;
+    policy.remove(set_number, way);
+    occupied[set_number]--;
+    return was_dirty;
 }
 
-int CacheLevel::getHits() const
+int64_t CacheLevel::getHits() const
 {
     return hits;
 }
 
-int CacheLevel::getMisses() const
+int64_t CacheLevel::getMisses() const
 {
     return misses;
 }
@@ -95,6 +159,16 @@ int CacheLevel::getBlockSize() const
     return blockSize;
 }
 
+InclusionPolicy CacheLevel::getInclusion() const
+{
+    return inclusion;
+}
+
+WritePolicy CacheLevel::getWritePolicy() const
+{
+    return writePolicy;
+}
+
 
 void CacheLevel::resetStats()
 {
@@ -1,71 +1,224 @@
 #include "cache_simulator.h"
 #include <iostream>
+#include <string>
 
 using namespace std;
 
 CacheSimulator::CacheSimulator(CacheLevel l1, CacheLevel l2)
-    : L1(l1), L2(l2)
+    : levels({l1, l2}), writebacks(2, 0), writeThroughs(2, 0)
 {
     memoryAccesses=0;
+    writeAccesses=0;
 }
 
-void CacheSimulator::access(int address)
+CacheSimulator::CacheSimulator(vector<CacheLevel> levels)
+    : levels(levels), writebacks(levels.size(), 0), writeThroughs(levels.size(), 0)
+{
+    memoryAccesses=0;
+    writeAccesses=0;
+}
+
+// Levels are looked up from L1 down until one hits; the block is then filled into the levels that missed,
+// except those exclusive of the level above them, which only receive its evictions.
+// Stores do not allocate in write-through levels: they pass the store on to the level below instead,
+// and the store ends at the highest level left holding the block, or in memory
+
+void CacheSimulator::access(uint64_t address, AccessType type)
 {
     memoryAccesses++;
-    int block_address=address/L1.getBlockSize();
-    // Hit in L1
-    if(L1.access(block_address)) return;
+    bool write=type==WRITE;
+    if(write) writeAccesses++;
+    int count=levels.size();
+
+    int source=count;       // level that hit, count for main memory
+    for(int i=0 ; i<count ; i++)
+    {
+        if(levels[i].access(levels[i].blockOf(address)))
+        {
+            source=i;
+            break;
+        }
+    }
+
+    int top=source;         // highest level holding the block once the fills are done
+    for(int i=source-1 ; i>=0 ; i--)
+    {
+        if((i==0 || levels[i].getInclusion()!=EXCLUSIVE) && (!write || levels[i].getWritePolicy()==WRITE_BACK))
+            top=i;
+    }
+
+    if(top<source)
+    {
+        // Promotion out of an exclusive level, which hands its dirty state to the new copy
+        bool dirty=false;
+        if(source<count && levels[source].getInclusion()==EXCLUSIVE)
+            dirty=levels[source].remove(levels[source].blockOf(address));
+
+        for(int i=source-1 ; i>=top ; i--)
+        {
+            if((i==0 || levels[i].getInclusion()!=EXCLUSIVE) && (!write || levels[i].getWritePolicy()==WRITE_BACK))
+                fill(i, address);
+        }
+        if(dirty) keepDirty(top, address);
+    }
+
+    if(!write) return;
+
+    for(int i=0 ; i<top ; i++)
+        writeThroughs[i]++;
+    if(top==count) return;  // Store went to memory
+
+    if(levels[top].getWritePolicy()==WRITE_BACK)
+        levels[top].markDirty(levels[top].blockOf(address));
+    else
+        writeDown(top, address, writeThroughs);
+}
+
+// An inclusive level below must hold the block as well; on the miss path it already does,
+// but a block demoted into an exclusive level may have left it since, possibly for an exclusive level further down
+
+void CacheSimulator::fill(int level, uint64_t address)
+{
+    int below=level+1;
+    if(below<(int)levels.size() && levels[below].getInclusion()==INCLUSIVE
+       && !levels[below].contains(levels[below].blockOf(address)))
+    {
+        bool dirty=false;
+        int next=below+1;
+        if(next<(int)levels.size() && levels[next].getInclusion()==EXCLUSIVE)
+            dirty=levels[next].remove(levels[next].blockOf(address));
+        fill(below, address);
+        if(dirty) keepDirty(below, address);
+    }
+
+    uint64_t evicted_address;
+    bool dirty;
+    if(levels[level].insert(levels[level].blockOf(address), &evicted_address, &dirty))
+        evict(level, evicted_address, dirty);
+}
+
+// An evicted block is back-invalidated from the level above if this level is inclusive,
+// and demoted to the level below if that level is exclusive; otherwise it is dropped.
+// Dirty data, its own or that of the invalidated copies above, is written back either way
+
+void CacheSimulator::evict(int level, uint64_t block_address, bool dirty)
+{
+    int blockSize=levels[level].getBlockSize();
+    uint64_t address=block_address*blockSize;
+
+    if(level>0 && levels[level].getInclusion()==INCLUSIVE)
+        dirty=invalidate(level-1, address, blockSize) || dirty;
 
-    // Hit in L2
-    if(L2.access(block_address))
+    int below=level+1;
+    if(below<(int)levels.size() && levels[below].getInclusion()==EXCLUSIVE
+       && !levels[below].contains(levels[below].blockOf(address)))
     {
-        int evicted_address=L1.insert(block_address);
-        L2.remove(block_address);
-        if(evicted_address!=-1) L2.insert(evicted_address);
+        fill(below, address);
+        if(dirty)
+        {
+            writebacks[level]++;
+            keepDirty(below, address);
+        }
         return;
     }
 
-    // Miss in L1 and L2
-    int evicted_address=L1.insert(block_address);
-    if(evicted_address!=-1) L2.insert(evicted_address);
+    if(dirty) writeDown(level, address, writebacks);
 }
 
-void CacheSimulator::printStats() const
+bool CacheSimulator::invalidate(int level, uint64_t start, uint64_t length)
 {
-    int l1Hits=L1.getHits();
-    int l1Misses=L1.getMisses();
+    int blockSize=levels[level].getBlockSize();
+    start=levels[level].blockOf(start)*blockSize;
 
-    int l2Hits=L2.getHits();
-    int l2Misses=L2.getMisses();
+    // Copies above are invalidated first, their dirty data merging into the lines removed here
+    bool dirtyAbove=false;
+    if(level>0 && levels[level].getInclusion()==INCLUSIVE)
+        dirtyAbove=invalidate(level-1, start, max(length, (uint64_t)blockSize));
 
-    cout<<"L1 Hits : "<<l1Hits<<endl;
-    cout<<"L1 Misses : "<<l1Misses<<endl;
+    bool dirty=dirtyAbove;
+    // Stepping an offset rather than the address keeps the last block of the address space from wrapping the loop
+    for(uint64_t offset=0 ; offset<length ; offset+=blockSize)
+    {
+        uint64_t block_address=levels[level].blockOf(start+offset);
+        bool present=levels[level].contains(block_address);
+        if(levels[level].remove(block_address) || (present && dirtyAbove))
+        {
+            writebacks[level]++;
+            dirty=true;
+        }
+    }
+    return dirty;
+}
 
-    if(l1Hits+l1Misses>0)
-        cout<<"L1 Hit Ratio : "<<(double)l1Hits/(l1Hits+l1Misses)<<endl;
-    else
-        cout<<"L1 Hit Ratio : 0"<<endl;
+void CacheSimulator::writeDown(int level, uint64_t address, vector<int64_t> &traffic)
+{
+    traffic[level]++;
 
-    cout<<endl;
+    int below=level+1;
+    if(below==(int)levels.size()) return;   // Reached memory
 
-    cout<<"L2 Hits : "<<l2Hits<<endl;
-    cout<<"L2 Misses : "<<l2Misses<<endl;
+    if(levels[below].getWritePolicy()==WRITE_BACK && levels[below].contains(levels[below].blockOf(address)))
+        levels[below].markDirty(levels[below].blockOf(address));
+    else
+        writeDown(below, address, traffic);
+}
 
-    if(l2Hits+l2Misses>0)
-        cout<<"L2 Hit Ratio : "<<(double)l2Hits/(l2Hits+l2Misses)<<endl;
+void CacheSimulator::keepDirty(int level, uint64_t address)
+{
+    if(levels[level].getWritePolicy()==WRITE_BACK)
+        levels[level].markDirty(levels[level].blockOf(address));
     else
-        cout<<"L2 Hit Ratio : 0"<<endl;
+        writeDown(level, address, writebacks);
+}
 
-    cout<<endl;
+void CacheSimulator::printStats() const
+{
+    for(size_t i=0 ; i<levels.size() ; i++)
+    {
+        int64_t hits=levels[i].getHits();
+        int64_t misses=levels[i].getMisses();
+
+        cout<<"L"<<i+1<<" Hits : "<<hits<<endl;
+        cout<<"L"<<i+1<<" Misses : "<<misses<<endl;
+
+        if(hits+misses>0)
+            cout<<"L"<<i+1<<" Hit Ratio : "<<(double)hits/(hits+misses)<<endl;
+        else
+            cout<<"L"<<i+1<<" Hit Ratio : 0"<<endl;
+
+        cout<<endl;
+    }
 
     cout<<"Miss Propagation:"<<endl;
-    cout<<"  L1 -> L2 accesses : "<<l1Misses<<endl;
-    cout<<"  L2 -> Memory accesses : "<<l2Misses<<endl;
+    for(size_t i=0 ; i<levels.size() ; i++)
+    {
+        cout<<"  L"<<i+1<<" -> ";
+        if(i+1<levels.size())
+            cout<<"L"<<i+2;
+        else
+            cout<<"Memory";
+        cout<<" accesses : "<<levels[i].getMisses()<<endl;
+    }
+
+    // Read-only runs move no data down the hierarchy, so the section is left out for them
+    if(writeAccesses==0) return;
+
+    cout<<endl;
+    cout<<"Write Traffic:"<<endl;
+    for(size_t i=0 ; i<levels.size() ; i++)
+    {
+        string boundary="  L"+to_string(i+1)+" -> "+(i+1<levels.size() ? "L"+to_string(i+2) : string("Memory"));
+        cout<<boundary<<" writebacks : "<<writebacks[i]<<endl;
+        cout<<boundary<<" write-throughs : "<<writeThroughs[i]<<endl;
+    }
 }
 
 void CacheSimulator::resetStats()
 {
-    L1.resetStats();
-    L2.resetStats();
+    for(auto &level:levels)
+        level.resetStats();
     memoryAccesses=0;
-}
\ No newline at end of file
+    writeAccesses=0;
+    writebacks.assign(levels.size(), 0);
+    writeThroughs.assign(levels.size(), 0);
+}
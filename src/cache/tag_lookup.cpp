@@ -0,0 +1,107 @@
+#include "tag_lookup.h"
+
+#ifdef TAG_LOOKUP_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+int findTagScalar(const int *tags, int ways, int tag)
+{
+    for(int way=0 ; way<ways ; way++)
+    {
+        if(tags[way]==tag)
+            return way;
+    }
+    return -1;
+}
+
+#ifdef TAG_LOOKUP_X86
+
+// Ways left over after the last full vector are compared one at a time
+
+int findTagSse2(const int *tags, int ways, int tag)
+{
+    __m128i key=_mm_set1_epi32(tag);
+    int way=0;
+    for( ; way+8<=ways ; way+=8)
+    {
+        __m128i low=_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags+way)), key);
+        __m128i high=_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags+way+4)), key);
+        int mask=_mm_movemask_ps(_mm_castsi128_ps(low)) | _mm_movemask_ps(_mm_castsi128_ps(high))<<4;
+        if(mask)
+            return way+__builtin_ctz(mask);
+    }
+    for( ; way+4<=ways ; way+=4)
+    {
+        int mask=_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags+way)), key)));
+        if(mask)
+            return way+__builtin_ctz(mask);
+    }
+    int rest=findTagScalar(tags+way, ways-way, tag);
+    return rest==-1 ? -1 : way+rest;
+}
+
+// Compiled for AVX2 on its own so the rest of the build keeps the baseline instruction set;
+// it only runs when the CPU reports AVX2
+
+__attribute__((target("avx2")))
+int findTagAvx2(const int *tags, int ways, int tag)
+{
+    __m256i key=_mm256_set1_epi32(tag);
+    int way=0;
+    for( ; way+16<=ways ; way+=16)
+    {
+        __m256i low=_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags+way)), key);
+        __m256i high=_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags+way+8)), key);
+        int mask=_mm256_movemask_ps(_mm256_castsi256_ps(low)) | _mm256_movemask_ps(_mm256_castsi256_ps(high))<<8;
+        if(mask)
+            return way+__builtin_ctz(mask);
+    }
+    if(way+8<=ways)
+    {
+        int mask=_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags+way)), key)));
+        if(mask)
+            return way+__builtin_ctz(mask);
+        way+=8;
+    }
+    if(way+4<=ways)
+    {
+        int mask=_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags+way)), _mm_set1_epi32(tag))));
+        if(mask)
+            return way+__builtin_ctz(mask);
+        way+=4;
+    }
+    int rest=findTagScalar(tags+way, ways-way, tag);
+    return rest==-1 ? -1 : way+rest;
+}
+
+#endif
+
+TagLookup bestTagLookup()
+{
+    static TagLookup best=supportedTagLookups().back();
+    return best;
+}
+
+vector<TagLookup> supportedTagLookups()
+{
+    vector<TagLookup> lookups={findTagScalar};
+#ifdef TAG_LOOKUP_X86
+    lookups.push_back(findTagSse2);
+    if(__builtin_cpu_supports("avx2"))
+        lookups.push_back(findTagAvx2);
+#endif
+    return lookups;
+}
+
+const char *tagLookupName(TagLookup lookup)
+{
+#ifdef TAG_LOOKUP_X86
+    if(lookup==findTagSse2)
+        return "sse2";
+    if(lookup==findTagAvx2)
+        return "avx2";
+#endif
+    return lookup==findTagScalar ? "scalar" : "unknown";
+}
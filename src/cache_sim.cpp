@@ -0,0 +1,268 @@
+// Streams a memory address trace through the cache simulator
+// A parser thread reads the trace into batches of accesses and hands them to the simulation thread
+// through a bounded ring, so traces far larger than memory run in constant space
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "address_trace.h"
+#include "cache_simulator.h"
+#include "spsc_ring.h"
+
+using namespace std;
+
+static const size_t BATCH_SIZE=1<<16;
+static const size_t RING_SLOTS=8;
+
+struct AccessBatch {
+    vector<AddressAccess> records;
+    size_t count;
+};
+
+static void usage()
+{
+    cerr<<"Usage: cache-sim <trace | -> [options]"<<endl;
+    cerr<<"  --level <size>,<block>,<assoc>[,<policy>[,<inclusion>[,<write>]]]"<<endl;
+    cerr<<"                  add a cache level, L1 first (default: 32768,64,8,lru and 262144,64,8,lru)"<<endl;
+    cerr<<"                  policy: fifo | lru | plru | srrip | brrip | lfu | random (default: lru)"<<endl;
+    cerr<<"                  inclusion of the level above: exclusive | inclusive | nine (default: exclusive)"<<endl;
+    cerr<<"                  write: wb (write-back, write-allocate) | wt (write-through, no-allocate) (default: wb)"<<endl;
+    cerr<<"  --data-only     skip instruction fetches"<<endl;
+    cerr<<"  --convert <f>   write the accesses to f as a binary delta trace instead of simulating them"<<endl;
+    cerr<<"  --fixed         write --convert output as fixed-width records"<<endl;
+    cerr<<"Traces are binary (written by --convert), hex addresses one per line, or Valgrind lackey output"<<endl;
+    cerr<<"(valgrind --tool=lackey --trace-mem=yes). Accesses spanning L1 blocks touch each block."<<endl;
+}
+
+
+
+// Split "a,b,c" at the commas
+static vector<string> fields(const char *spec)
+{
+    vector<string> parts;
+    const char *start=spec;
+    for(const char *p=spec ; ; p++)
+    {
+        if(*p==',' || *p==0)
+        {
+            parts.push_back(string(start, p-start));
+            if(*p==0)
+                break;
+            start=p+1;
+        }
+    }
+    return parts;
+}
+
+static bool parseLevel(const char *spec, vector<CacheLevel> &levels)
+{
+    vector<string> parts=fields(spec);
+    if(parts.size()<3 || parts.size()>6)
+        return false;
+
+    int size=atoi(parts[0].c_str());
+    int block=atoi(parts[1].c_str());
+    int associativity=atoi(parts[2].c_str());
+    if(size<=0 || block<=0 || associativity<=0 || size%((long long)block*associativity)!=0)
+        return false;
+
+    ReplacementPolicy policy=LRU;
+    if(parts.size()>3)
+    {
+        const string &name=parts[3];
+        if(name=="fifo")        policy=FIFO;
+        else if(name=="lru")    policy=LRU;
+        else if(name=="plru")   policy=TREE_PLRU;
+        else if(name=="srrip")  policy=SRRIP;
+        else if(name=="brrip")  policy=BRRIP;
+        else if(name=="lfu")    policy=LFU;
+        else if(name=="random") policy=RANDOM;
+        else
+            return false;
+    }
+
+    InclusionPolicy inclusion=EXCLUSIVE;
+    if(parts.size()>4)
+    {
+        const string &name=parts[4];
+        if(name=="exclusive")       inclusion=EXCLUSIVE;
+        else if(name=="inclusive")  inclusion=INCLUSIVE;
+        else if(name=="nine")       inclusion=NINE;
+        else
+            return false;
+    }
+
+    WritePolicy writePolicy=WRITE_BACK;
+    if(parts.size()>5)
+    {
+        if(parts[5]=="wb")          writePolicy=WRITE_BACK;
+        else if(parts[5]=="wt")     writePolicy=WRITE_THROUGH;
+        else
+            return false;
+    }
+
+    levels.push_back(CacheLevel(size, block, associativity, policy, inclusion, writePolicy));
+    return true;
+}
+
+static const char *formatName(AddressTraceFormat format)
+{
+    switch(format)
+    {
+        case ADDRESS_TEXT:  return "text";
+        case ADDRESS_FIXED: return "binary fixed";
+        case ADDRESS_DELTA: return "binary delta";
+    }
+    return "unknown";
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    if(argc<2)
+    {
+        usage();
+        return 1;
+    }
+
+    vector<CacheLevel> levels;
+    bool dataOnly=false, fixed=false;
+    const char *convertPath=NULL;
+    for(int i=2 ; i<argc ; i++)
+    {
+        if(strcmp(argv[i], "--level")==0 && i+1<argc && parseLevel(argv[i+1], levels)) i++;
+        else if(strcmp(argv[i], "--data-only")==0) dataOnly=true;
+        else if(strcmp(argv[i], "--convert")==0 && i+1<argc) convertPath=argv[++i];
+        else if(strcmp(argv[i], "--fixed")==0) fixed=true;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(fixed && !convertPath)
+    {
+        usage();
+        return 1;
+    }
+    if(levels.empty())
+    {
+        levels.push_back(CacheLevel(32768, 64, 8, LRU));
+        levels.push_back(CacheLevel(262144, 64, 8, LRU));
+    }
+
+    AddressTraceReader reader;
+    if(!reader.open(argv[1]))
+    {
+        cerr<<"cache-sim: "<<reader.error()<<endl;
+        return 1;
+    }
+
+    AddressTraceWriter writer;
+    if(convertPath && !writer.open(convertPath, fixed ? ADDRESS_FIXED : ADDRESS_DELTA))
+    {
+        cerr<<"cache-sim: cannot write "<<convertPath<<endl;
+        return 1;
+    }
+
+    ios::sync_with_stdio(false);
+
+    CacheSimulator cache(levels);
+    uint64_t blockSize=levels[0].getBlockSize();
+    long long records=0, reads=0, writes=0, fetches=0, skipped=0, accesses=0;
+
+    SpscRing<AccessBatch> ring(RING_SLOTS);
+    auto startTime=chrono::steady_clock::now();
+
+    // The parser fills ring slots in place; an empty batch means the trace ended or failed to parse
+    thread parser([&]()
+    {
+        while(true)
+        {
+            AccessBatch &batch=ring.acquire();
+            if(batch.records.size()<BATCH_SIZE)
+                batch.records.resize(BATCH_SIZE);
+            batch.count=reader.read(batch.records.data(), BATCH_SIZE);
+            if(batch.count==0)
+                break;
+            ring.publish();
+        }
+        ring.close();
+    });
+
+    while(AccessBatch *batch=ring.front())
+    {
+        for(size_t i=0 ; i<batch->count ; i++)
+        {
+            const AddressAccess &record=batch->records[i];
+            records++;
+            if(record.type==INSTRUCTION_FETCH)
+            {
+                if(dataOnly)
+                {
+                    skipped++;
+                    continue;
+                }
+                fetches++;
+            }
+            else if(record.type==WRITE)
+                writes++;
+            else
+                reads++;
+
+            // One access per L1 block the record touches
+            uint64_t first=record.address/blockSize;
+            uint64_t last=record.size>1 ? (record.address+record.size-1)/blockSize : first;
+            for(uint64_t block=first ; block<=last ; block++)
+            {
+                uint64_t address=block==first ? record.address : block*blockSize;
+                if(convertPath)
+                    writer.write(address, record.type);
+                else
+                    cache.access(address, record.type);
+                accesses++;
+            }
+        }
+        ring.release();
+    }
+    parser.join();
+    double seconds=chrono::duration<double>(chrono::steady_clock::now()-startTime).count();
+
+    if(reader.failed())
+    {
+        cerr<<"cache-sim: "<<reader.error()<<endl;
+        return 1;
+    }
+    if(convertPath && !writer.close())
+    {
+        cerr<<"cache-sim: cannot write "<<convertPath<<endl;
+        return 1;
+    }
+
+    if(!convertPath)
+    {
+        cache.printStats();
+        cout<<endl;
+    }
+
+    // A trace converted to stdout keeps it binary, the summary goes to stderr instead
+    ostream &out=convertPath && strcmp(convertPath, "-")==0 ? cerr : cout;
+    out<<"Trace Summary"<<endl;
+    out<<"Format = "<<formatName(reader.getFormat())<<endl;
+    out<<"Records = "<<records<<" ("<<reads<<" reads, "<<writes<<" writes, "<<fetches<<" instruction fetches";
+    if(skipped>0)
+        out<<", "<<skipped<<" skipped";
+    out<<")"<<endl;
+    if(convertPath)
+        out<<"Written = "<<accesses<<" accesses to "<<convertPath<<endl;
+    else
+        out<<"Accesses = "<<accesses<<endl;
+    out<<"Elapsed = "<<seconds<<" s"<<endl;
+    out<<"Throughput = "<<(seconds>0 ? records/seconds : 0)<<" records/sec"<<endl;
+    return 0;
+}
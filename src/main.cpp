@@ -1,12 +1,14 @@
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <vector>
 #include "allocator.h"
 
 using namespace std;
 
 int main()
 {
-    int memorySize;
+    mem_size_t memorySize;
     cout<<"Enter total memory size: ";
     cin>>memorySize;
     Allocator allocator(memorySize);
@@ -15,34 +17,59 @@ int main()
     cout<<"  malloc firstFit <size>"<<endl;
     cout<<"  malloc bestFit <size>"<<endl;
     cout<<"  malloc worstFit <size>"<<endl;
+    cout<<"  malloc nextFit <size>"<<endl;
+    cout<<"  malloc tlsf <size>"<<endl;
+    cout<<"  malloc buddy <size>"<<endl;
+    cout<<"  memalign <strategy> <size> <alignment>"<<endl;
+    cout<<"  layout <header> <footer> <alignment>"<<endl;
+    cout<<"  slab <slabSize> <classSize,classSize,...>"<<endl;
+    cout<<"  realloc <id> <size>"<<endl;
     cout<<"  free <id>"<<endl;
+    cout<<"  compact"<<endl;
+    cout<<"  autocompact on|off"<<endl;
     cout << "  dump"<<endl;
     cout << "  stats"<<endl;
+    cout << "  histogram"<<endl;
+    cout<<"  save <file>"<<endl;
+    cout<<"  load <file>"<<endl;
     cout << "  exit"<<endl<<endl;
 
     string cmd;
+    AllocationStrategy lastStrategy=FIRST_FIT;     // realloc moves blocks with the strategy of the last malloc
 
     while (true)
     {
         cout<< "> ";
-        cin>>cmd;
+        if(!(cin>>cmd))
+            break;
 
-        if(cmd=="malloc")
+        if(cmd=="malloc" || cmd=="memalign")
         {
             string type;
-            int size;
+            mem_size_t size, alignment=0;
 
             cin>>type>>size;
-            int id=-1;
+            if(cmd=="memalign")
+                cin>>alignment;
+            alloc_id_t id=-1;
 
             if(type=="firstFit")
-                id=allocator.allocateFirstFit(size);
+                lastStrategy=FIRST_FIT;
 
             else if(type=="bestFit")
-                id=allocator.allocateBestFit(size);
+                lastStrategy=BEST_FIT;
 
             else if(type=="worstFit")
-                id=allocator.allocateWorstFit(size);
+                lastStrategy=WORST_FIT;
+
+            else if(type=="nextFit")
+                lastStrategy=NEXT_FIT;
+
+            else if(type=="tlsf")
+                lastStrategy=TLSF;
+
+            else if(type=="buddy")
+                lastStrategy=BUDDY;
 
             else
             {
@@ -50,6 +77,8 @@ int main()
                 continue;
             }
 
+            id=allocator.allocate(lastStrategy, size, alignment);
+
 
             if(id==-1)
                 cout<<"Allocation failed"<<endl;
@@ -58,12 +87,74 @@ int main()
                 cout<<"Allocated block with ID "<<id<<endl;
         }
 
+        else if (cmd=="layout")
+        {
+            mem_size_t header, footer, alignment;
+            cin>>header>>footer>>alignment;
+            if(allocator.configureLayout(header, footer, alignment))
+                cout<<"Block layout configured"<<endl;
+            else
+                cout<<"Invalid block layout"<<endl;
+        }
+
+        else if (cmd=="slab")
+        {
+            int slabSize;
+            string list;
+            cin>>slabSize>>list;
+
+            vector<int> classSizes;
+            stringstream ss(list);
+            string item;
+            while(getline(ss, item, ','))
+                classSizes.push_back(atoi(item.c_str()));
+
+            if(allocator.configureSlabs(classSizes, slabSize))
+                cout<<"Slab classes configured"<<endl;
+            else
+                cout<<"Invalid slab configuration"<<endl;
+        }
+
+        else if (cmd=="realloc")
+        {
+            alloc_id_t id;
+            mem_size_t size;
+            cin>>id>>size;
+            if(allocator.reallocate(id, size, lastStrategy))
+                cout<<"Reallocated block ID "<<id<<" to size "<<size<<endl;
+            else
+                cout<<"Reallocation of ID "<<id<<" failed"<<endl;
+        }
+
         else if (cmd=="free")
         {
-            int id;
+            alloc_id_t id;
             cin>>id;
-            allocator.freeBlock(id);
-            cout<<"Freed block ID "<<id<<endl;
+            if(allocator.freeBlock(id))
+                cout<<"Freed block ID "<<id<<endl;
+            else
+                cout<<"Invalid free: ID "<<id<<" is not allocated"<<endl;
+        }
+
+        else if (cmd=="compact")
+        {
+            CompactionResult result=allocator.compact();
+            for(auto &relocation:result.relocations)
+                cout<<"ID "<<relocation.id<<": "<<relocation.oldStart<<" -> "<<relocation.newStart<<endl;
+            cout<<"Compaction moved "<<result.relocations.size()<<" allocations ("<<result.bytesMoved<<" bytes)"<<endl;
+        }
+
+        else if (cmd=="autocompact")
+        {
+            string mode;
+            cin>>mode;
+            if(mode=="on" || mode=="off")
+            {
+                allocator.setAutoCompact(mode=="on");
+                cout<<"Auto-compaction "<<mode<<endl;
+            }
+            else
+                cout<<"Usage: autocompact on|off"<<endl;
         }
 
         else if (cmd=="dump")
@@ -72,6 +163,29 @@ int main()
         else if (cmd=="stats")  
             allocator.printStats();
 
+        else if (cmd=="histogram")
+            allocator.printFreeHistogram();
+
+        else if (cmd=="save")
+        {
+            string path;
+            cin>>path;
+            if(allocator.saveSnapshot(path.c_str()))
+                cout<<"Snapshot saved to "<<path<<endl;
+            else
+                cout<<"Cannot write snapshot "<<path<<endl;
+        }
+
+        else if (cmd=="load")
+        {
+            string path;
+            cin>>path;
+            if(allocator.loadSnapshot(path.c_str()))
+                cout<<"Snapshot loaded from "<<path<<endl;
+            else
+                cout<<"Cannot load snapshot "<<path<<endl;
+        }
+
         else if (cmd=="exit")
             break;
 
@@ -0,0 +1,462 @@
+// Non-interactive trace replay for the allocator
+// Reads the CLI command format, runs it without prompts or per-command output,
+// and reports the throughput at the end
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <time.h>
+#include "allocator.h"
+#include "fragmentation_sampler.h"
+#include "thread_arena.h"
+#include "trace.h"
+
+using namespace std;
+
+static void usage()
+{
+    cerr<<"Usage: memory-replay <trace | -> [options]"<<endl;
+    cerr<<"  --echo        run dump, stats and histogram commands found in the trace"<<endl;
+    cerr<<"  --dump        dump memory at the end"<<endl;
+    cerr<<"  --stats       print statistics at the end"<<endl;
+    cerr<<"  --histogram   print the free block histogram at the end"<<endl;
+    cerr<<"  --threads     replay each t<N> thread of the trace on its own OS thread and arena"<<endl;
+    cerr<<"  --chunk <n>   arena refill size in bytes for --threads (default: memory / (4 * threads))"<<endl;
+    cerr<<"  --compare [s,s,...]  replay once per strategy in parallel and print a table (default: all strategies)"<<endl;
+    cerr<<"  --layout <h>,<f>,<a>  give every block an h-byte header and f-byte footer, align payloads to a bytes"<<endl;
+    cerr<<"  --load-snapshot <f>  start from a saved allocator state instead of an empty heap"<<endl;
+    cerr<<"  --save-snapshot <f>  save the allocator state at the end of the replay"<<endl;
+    cerr<<"  --sample <n>         record fragmentation every n operations and after every failed one (0: failures only)"<<endl;
+    cerr<<"  --sample-capacity <n>  samples kept, older ones are overwritten (default: 1048576)"<<endl;
+    cerr<<"  --sample-out <f>     write the samples to f, binary if the name ends in .bin (default: samples.csv)"<<endl;
+}
+
+
+
+// CPU time of the calling thread, unaffected by other threads sharing its core
+
+static double threadCpuSeconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec+now.tv_nsec*1e-9;
+}
+
+
+
+// Header size, footer size and default alignment for Allocator::configureLayout, all 0 if not given
+
+struct BlockLayout {
+    mem_size_t header;
+    mem_size_t footer;
+    mem_size_t alignment;
+};
+
+static bool parseLayout(const char *text, BlockLayout &layout)
+{
+    long long header, footer, alignment;
+    if(sscanf(text, "%lld,%lld,%lld", &header, &footer, &alignment)!=3)
+        return false;
+    layout.header=header;
+    layout.footer=footer;
+    layout.alignment=alignment;
+    return Allocator::validLayout(header, footer, alignment);
+}
+
+static void applyLayout(Allocator &allocator, const BlockLayout &layout)
+{
+    if(layout.alignment>0)
+        allocator.configureLayout(layout.header, layout.footer, layout.alignment);
+}
+
+
+
+// Parse the trace once into an immutable op buffer, then replay it on one OS thread per strategy,
+// every engine reading the same buffer; malloc, memalign and realloc use the engine's strategy instead of the trace's
+// Slab, layout, compact and autocompact commands are replayed as well, dump, stats and histogram are skipped
+// Slab and layout commands an engine rejects are reported after the run, like the single-engine replay does
+// Ops/sec is measured on each engine's thread CPU time, so engines sharing a core do not slow each other down on paper
+
+static int replayCompare(TraceReader &reader, const vector<AllocationStrategy> &strategies, const BlockLayout &layout)
+{
+    vector<TraceOp> ops;
+    vector<vector<int>> slabConfigs;    // class sizes of each slab command, in trace order
+    TraceOp op;
+    while(reader.next(op))
+    {
+        if(op.type==OP_SLAB)
+            slabConfigs.push_back(reader.getSlabClasses());
+        ops.push_back(op);
+    }
+    if(reader.failed())
+    {
+        cerr<<"memory-replay: "<<reader.error()<<endl;
+        return 1;
+    }
+
+    int engineCount=(int)strategies.size();
+    vector<AllocatorStats> results(engineCount);
+    vector<double> seconds(engineCount);
+    vector<int> badSlabs(engineCount, 0), badLayouts(engineCount, 0);
+
+    vector<thread> workers;
+    for(int e=0 ; e<engineCount ; e++)
+        workers.emplace_back([&, e]()
+        {
+            Allocator allocator(reader.getMemorySize());
+            applyLayout(allocator, layout);
+            AllocationStrategy strategy=strategies[e];
+            size_t slabCommand=0;
+            double engineStart=threadCpuSeconds();
+            for(const TraceOp &engineOp:ops)
+            {
+                switch(engineOp.type)
+                {
+                    case OP_MALLOC:         allocator.allocate(strategy, engineOp.value); break;
+                    case OP_MEMALIGN:       allocator.allocate(strategy, engineOp.value, engineOp.alignment); break;
+                    case OP_FREE:           allocator.freeBlock(engineOp.value); break;
+                    case OP_REALLOC:        allocator.reallocate(engineOp.value, engineOp.size, strategy); break;
+                    case OP_SLAB:
+                        if(!allocator.configureSlabs(slabConfigs[slabCommand++], engineOp.value))
+                            badSlabs[e]++;
+                        break;
+                    case OP_LAYOUT:
+                        if(!allocator.configureLayout(engineOp.value, engineOp.size, engineOp.alignment))
+                            badLayouts[e]++;
+                        break;
+                    case OP_COMPACT:        allocator.compact(); break;
+                    case OP_AUTOCOMPACT:    allocator.setAutoCompact(engineOp.value==1); break;
+                    default:                break;
+                }
+            }
+            seconds[e]=threadCpuSeconds()-engineStart;
+            results[e]=allocator.getStats();
+        });
+    for(auto &worker:workers)
+        worker.join();
+
+    for(int e=0 ; e<engineCount ; e++)
+    {
+        for(int i=0 ; i<badSlabs[e] ; i++)
+            cerr<<"memory-replay: "<<strategyName(strategies[e])<<": invalid slab configuration ignored"<<endl;
+        for(int i=0 ; i<badLayouts[e] ; i++)
+            cerr<<"memory-replay: "<<strategyName(strategies[e])<<": invalid block layout ignored"<<endl;
+    }
+
+    cout<<"Strategy Comparison ("<<ops.size()<<" operations)"<<endl;
+    cout<<left<<setw(10)<<"Strategy"<<right<<setw(14)<<"Utilization"<<setw(14)<<"Ext Frag"
+        <<setw(14)<<"Failure Rate"<<setw(16)<<"Ops/sec"<<endl;
+    cout<<fixed<<setprecision(2);
+    for(int e=0 ; e<engineCount ; e++)
+    {
+        const AllocatorStats &stats=results[e];
+        double utilization=(double)stats.usedBytes/stats.totalSize*100;
+        double external=stats.freeBytes>0 ? (double)(stats.freeBytes-stats.largestFreeBlock)/stats.freeBytes*100 : 0;
+        double failures=stats.allocRequests>0 ? (double)stats.allocFailures/stats.allocRequests*100 : 0;
+        cout<<left<<setw(10)<<strategyName(strategies[e])<<right
+            <<setw(13)<<utilization<<"%"<<setw(13)<<external<<"%"<<setw(13)<<failures<<"%"
+            <<setw(16)<<setprecision(0)<<(seconds[e]>0 ? ops.size()/seconds[e] : 0)<<setprecision(2)<<endl;
+    }
+    return 0;
+}
+
+
+
+// Every simulated thread replays its own commands on a real OS thread, against its own ThreadArena,
+// and all arenas refill from one SharedHeap
+// The trace is parsed up front so the timing covers allocation work only
+// Allocation IDs are per thread; slab, layout, compact, dump, stats and histogram commands are ignored
+// Busy time is each thread's CPU time
+
+static int replayThreads(TraceReader &reader, mem_size_t chunkSize)
+{
+    vector<vector<TraceOp>> perThread(1);
+    TraceOp op;
+    while(reader.next(op))
+    {
+        if((int)perThread.size()<=op.thread)
+            perThread.resize(op.thread+1);
+        perThread[op.thread].push_back(op);
+    }
+    if(reader.failed())
+    {
+        cerr<<"memory-replay: "<<reader.error()<<endl;
+        return 1;
+    }
+
+    int threadCount=(int)perThread.size();
+    if(chunkSize<=0)
+        chunkSize=max<mem_size_t>(1, reader.getMemorySize()/(4*threadCount));
+    SharedHeap shared(reader.getMemorySize(), chunkSize);
+
+    vector<unique_ptr<ThreadArena>> arenas;
+    for(int t=0 ; t<threadCount ; t++)
+        arenas.emplace_back(new ThreadArena(shared));
+    vector<double> busySeconds(threadCount);
+
+    auto startTime=chrono::steady_clock::now();
+    vector<thread> workers;
+    for(int t=0 ; t<threadCount ; t++)
+        workers.emplace_back([&, t]()
+        {
+            double threadStart=threadCpuSeconds();
+            ThreadArena &arena=*arenas[t];
+            for(auto &threadOp:perThread[t])
+            {
+                if(threadOp.type==OP_MALLOC)
+                    arena.allocate(threadOp.strategy, threadOp.value);
+                else if(threadOp.type==OP_MEMALIGN)
+                    arena.allocate(threadOp.strategy, threadOp.value, threadOp.alignment);
+                else if(threadOp.type==OP_FREE)
+                    arena.freeBlock(threadOp.value);
+                else if(threadOp.type==OP_REALLOC)
+                    arena.reallocate(threadOp.value, threadOp.size, threadOp.strategy);
+            }
+            busySeconds[t]=threadCpuSeconds()-threadStart;
+        });
+    for(auto &worker:workers)
+        worker.join();
+    double seconds=chrono::duration<double>(chrono::steady_clock::now()-startTime).count();
+
+    long long operations=0;
+    cout<<"Concurrent Replay"<<endl;
+    cout<<"Threads = "<<threadCount<<endl;
+    cout<<"Chunk Size = "<<chunkSize<<" ("<<shared.getChunkCount()<<" chunks)"<<endl;
+    for(int t=0 ; t<threadCount ; t++)
+    {
+        ArenaStats stats=arenas[t]->getStats();
+        operations+=perThread[t].size();
+        cout<<"Arena "<<t<<" : operations = "<<perThread[t].size()
+            <<", allocations = "<<stats.allocRequests<<" ("<<stats.allocFailures<<" failed)"
+            <<", frees = "<<stats.frees+stats.invalidFrees<<" ("<<stats.invalidFrees<<" invalid)"
+            <<", reallocations = "<<stats.reallocs
+            <<", refills = "<<stats.refills<<", returned = "<<stats.chunksReturned
+            <<", chunks = "<<stats.chunks<<" (peak "<<stats.peakChunks<<")"
+            <<", used = "<<stats.usedBytes<<", free = "<<stats.freeBytes
+            <<", external fragmentation = "<<(stats.freeBytes>0 ? (double)(stats.freeBytes-stats.largestFreeBlock)/stats.freeBytes*100 : 0)<<"%"
+            <<", busy = "<<busySeconds[t]<<" s"<<endl;
+    }
+    cout<<"Shared Heap : chunks in use = "<<shared.chunksInUse()<<" (peak "<<shared.peakChunksInUse()<<")"
+        <<", CAS retries = "<<shared.casRetries()<<endl;
+    cout<<"Elapsed = "<<seconds<<" s"<<endl;
+    cout<<"Throughput = "<<(seconds>0 ? operations/seconds : 0)<<" ops/sec"<<endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc<2)
+    {
+        usage();
+        return 1;
+    }
+
+    bool echo=false, dump=false, stats=false, histogram=false, threads=false, compare=false;
+    mem_size_t chunkSize=0;
+    const char *loadPath=NULL, *savePath=NULL;
+    BlockLayout layout={0, 0, 0};
+    int64_t sampleInterval=-1, sampleCapacity=1<<20;
+    const char *samplePath="samples.csv";
+    vector<AllocationStrategy> strategies;
+    for(int i=2 ; i<argc ; i++)
+    {
+        if(strcmp(argv[i], "--echo")==0) echo=true;
+        else if(strcmp(argv[i], "--compare")==0)
+        {
+            compare=true;
+            if(i+1<argc && strncmp(argv[i+1], "--", 2)!=0 && !parseStrategyList(argv[++i], strategies))
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--threads")==0) threads=true;
+        else if(strcmp(argv[i], "--chunk")==0 && i+1<argc && atoll(argv[i+1])>0) chunkSize=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--dump")==0) dump=true;
+        else if(strcmp(argv[i], "--stats")==0) stats=true;
+        else if(strcmp(argv[i], "--histogram")==0) histogram=true;
+        else if(strcmp(argv[i], "--layout")==0 && i+1<argc && parseLayout(argv[i+1], layout)) i++;
+        else if(strcmp(argv[i], "--load-snapshot")==0 && i+1<argc) loadPath=argv[++i];
+        else if(strcmp(argv[i], "--save-snapshot")==0 && i+1<argc) savePath=argv[++i];
+        else if(strcmp(argv[i], "--sample")==0 && i+1<argc && atoll(argv[i+1])>=0) sampleInterval=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--sample-capacity")==0 && i+1<argc && atoll(argv[i+1])>0) sampleCapacity=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--sample-out")==0 && i+1<argc) samplePath=argv[++i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if(((threads || compare) && (loadPath || savePath || sampleInterval>=0)) || (threads && layout.alignment>0))
+    {
+        usage();
+        return 1;
+    }
+
+    TraceReader reader;
+    if(!reader.open(argv[1]))
+    {
+        cerr<<"memory-replay: "<<reader.error()<<endl;
+        return 1;
+    }
+
+    // Large output buffer, nothing is flushed until the end unless a dump or stats command asks for it
+    ios::sync_with_stdio(false);
+    static char outputBuffer[1<<20];
+    cout.rdbuf()->pubsetbuf(outputBuffer, sizeof(outputBuffer));
+
+    if(threads)
+        return replayThreads(reader, chunkSize);
+    if(compare)
+    {
+        if(strategies.empty())
+            strategies={FIRST_FIT, NEXT_FIT, BEST_FIT, WORST_FIT, TLSF, BUDDY};
+        return replayCompare(reader, strategies, layout);
+    }
+
+    // A restored heap keeps its own size and layout, the trace's memory size and --layout are ignored
+    Allocator allocator(loadPath ? 1 : reader.getMemorySize());
+    if(loadPath)
+    {
+        auto restoreStart=chrono::steady_clock::now();
+        if(!allocator.loadSnapshot(loadPath))
+        {
+            cerr<<"memory-replay: cannot load snapshot "<<loadPath<<endl;
+            return 1;
+        }
+        cout<<"Restored "<<loadPath<<" in "<<chrono::duration<double>(chrono::steady_clock::now()-restoreStart).count()<<" s"<<endl;
+    }
+    else
+        applyLayout(allocator, layout);
+
+    unique_ptr<FragmentationSampler> sampler;
+    if(sampleInterval>=0)
+        sampler.reset(new FragmentationSampler(sampleCapacity, sampleInterval));
+
+    long long operations=0, allocations=0, failedAllocations=0, frees=0, invalidFrees=0, reallocations=0, failedReallocations=0;
+    TraceOp op;
+
+    auto startTime=chrono::steady_clock::now();
+    while(reader.next(op))
+    {
+        operations++;
+        bool failed=false;
+        switch(op.type)
+        {
+            case OP_MALLOC:
+            case OP_MEMALIGN:
+                allocations++;
+                if(allocator.allocate(op.strategy, op.value, op.type==OP_MEMALIGN ? op.alignment : 0)==-1)
+                {
+                    failedAllocations++;
+                    failed=true;
+                }
+                break;
+
+            case OP_FREE:
+                frees++;
+                if(!allocator.freeBlock(op.value))
+                    invalidFrees++;
+                break;
+
+            case OP_REALLOC:
+                reallocations++;
+                if(!allocator.reallocate(op.value, op.size, op.strategy))
+                {
+                    failedReallocations++;
+                    failed=true;
+                }
+                break;
+
+            case OP_SLAB:
+                if(!allocator.configureSlabs(reader.getSlabClasses(), op.value))
+                    cerr<<"memory-replay: invalid slab configuration ignored"<<endl;
+                break;
+
+            case OP_LAYOUT:
+                if(!allocator.configureLayout(op.value, op.size, op.alignment))
+                    cerr<<"memory-replay: invalid block layout ignored"<<endl;
+                break;
+
+            case OP_COMPACT:
+                allocator.compact();
+                break;
+
+            case OP_AUTOCOMPACT:
+                allocator.setAutoCompact(op.value==1);
+                break;
+
+            case OP_DUMP:
+                if(echo) allocator.dumpMemory();
+                break;
+
+            case OP_STATS:
+                if(echo) allocator.printStats();
+                break;
+
+            case OP_HISTOGRAM:
+                if(echo) allocator.printFreeHistogram();
+                break;
+
+            case OP_EXIT:
+                break;
+        }
+        if(sampler)
+            sampler->record(allocator, failed);
+    }
+    double seconds=chrono::duration<double>(chrono::steady_clock::now()-startTime).count();
+
+    if(reader.failed())
+    {
+        cout<<flush;
+        cerr<<"memory-replay: "<<reader.error()<<endl;
+        return 1;
+    }
+
+    if(savePath && !allocator.saveSnapshot(savePath))
+    {
+        cout<<flush;
+        cerr<<"memory-replay: cannot write snapshot "<<savePath<<endl;
+        return 1;
+    }
+
+    if(sampler)
+    {
+        bool binary=strlen(samplePath)>4 && strcmp(samplePath+strlen(samplePath)-4, ".bin")==0;
+        ofstream out(samplePath, binary ? ios::binary : ios::out);
+        if(binary)
+            sampler->writeBinary(out);
+        else
+            sampler->writeCsv(out);
+        if(!out)
+        {
+            cout<<flush;
+            cerr<<"memory-replay: cannot write samples to "<<samplePath<<endl;
+            return 1;
+        }
+    }
+
+    if(dump) allocator.dumpMemory();
+    if(stats) allocator.printStats();
+    if(histogram) allocator.printFreeHistogram();
+
+    cout<<"Replay Summary"<<endl;
+    cout<<"Operations = "<<operations<<endl;
+    cout<<"Allocations = "<<allocations<<" ("<<failedAllocations<<" failed)"<<endl;
+    cout<<"Frees = "<<frees<<" ("<<invalidFrees<<" invalid)"<<endl;
+    if(reallocations>0)
+        cout<<"Reallocations = "<<reallocations<<" ("<<failedReallocations<<" failed)"<<endl;
+    if(sampler)
+        cout<<"Samples = "<<sampler->size()<<" ("<<sampler->dropped()<<" overwritten) written to "<<samplePath<<endl;
+    cout<<"Elapsed = "<<seconds<<" s"<<endl;
+    cout<<"Throughput = "<<(seconds>0 ? operations/seconds : 0)<<" ops/sec"<<endl;
+    return 0;
+}
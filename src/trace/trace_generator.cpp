@@ -0,0 +1,204 @@
+#include "trace_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+WorkloadConfig::WorkloadConfig()
+{
+    operations=1000000;
+    memorySize=1LL<<30;
+    seed=1;
+    sizeModel=SIZE_UNIFORM;
+    minSize=16;
+    maxSize=4096;
+    alpha=2.0;
+    smallSize=64;
+    largeSize=65536;
+    smallFraction=0.9;
+    lifetimeModel=LIFETIME_RANDOM;
+    longLivedFraction=0.1;
+    liveTarget=10000;
+    reallocFraction=0;
+    threads=1;
+    strategies.push_back(FIRST_FIT);
+}
+
+
+
+bool loadSizeHistogram(const string &path, vector<SizeBucket> &buckets)
+{
+    ifstream in(path);
+    if(!in)
+        return false;
+
+    buckets.clear();
+    string text;
+    while(getline(in, text))
+    {
+        SizeBucket bucket;
+        char open, dash, close, colon;
+        istringstream line(text);
+        if(!text.empty() && text[0]=='[')
+        {
+            if(!(line>>open>>bucket.low>>dash>>bucket.high>>close>>colon>>bucket.count))
+                continue;
+        }
+        else
+        {
+            if(!(line>>bucket.low>>bucket.count))
+                continue;
+            bucket.high=bucket.low;
+        }
+        if(bucket.low>0 && bucket.high>=bucket.low && bucket.count>0)
+            buckets.push_back(bucket);
+    }
+    return !buckets.empty();
+}
+
+
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadConfig &config) : config(config)
+{
+    state=config.seed ? config.seed : 0x9E3779B97F4A7C15ULL;   // xorshift must not start at 0
+    int64_t total=0;
+    for(auto &bucket:config.buckets)
+    {
+        total+=bucket.count;
+        bucketTotals.push_back(total);
+    }
+}
+
+uint64_t WorkloadGenerator::nextRandom()
+{
+    state^=state>>12;
+    state^=state<<25;
+    state^=state>>27;
+    return state*0x2545F4914F6CDD1DULL;
+}
+
+uint64_t WorkloadGenerator::below(uint64_t n)
+{
+    return (uint64_t)(((unsigned __int128)nextRandom()*n)>>64);
+}
+
+double WorkloadGenerator::unit()
+{
+    return (nextRandom()>>11)*(1.0/9007199254740992.0);
+}
+
+
+
+// Power law sizes come from inverting the CDF of the truncated continuous distribution
+
+int64_t WorkloadGenerator::drawSize()
+{
+    switch(config.sizeModel)
+    {
+        case SIZE_UNIFORM:
+            return config.minSize+(int64_t)below(config.maxSize-config.minSize+1);
+
+        case SIZE_POWER_LAW:
+        {
+            double low=(double)config.minSize, high=(double)config.maxSize+1;
+            double u=unit(), x;
+            if(fabs(config.alpha-1.0)<1e-9)
+                x=low*pow(high/low, u);
+            else
+            {
+                double e=1.0-config.alpha;
+                x=pow(pow(low, e)+u*(pow(high, e)-pow(low, e)), 1.0/e);
+            }
+            return min(config.maxSize, max(config.minSize, (int64_t)x));
+        }
+
+        case SIZE_BIMODAL:
+            return unit()<config.smallFraction ? config.smallSize : config.largeSize;
+
+        case SIZE_HISTOGRAM:
+        {
+            int64_t pick=(int64_t)below(bucketTotals.back());
+            size_t b=upper_bound(bucketTotals.begin(), bucketTotals.end(), pick)-bucketTotals.begin();
+            const SizeBucket &bucket=config.buckets[b];
+            return bucket.low+(int64_t)below(bucket.high-bucket.low+1);
+        }
+    }
+    return config.minSize;
+}
+
+alloc_id_t WorkloadGenerator::takeLive(ThreadState &thread)
+{
+    deque<alloc_id_t> &live=thread.live;
+    alloc_id_t id;
+    if(config.lifetimeModel==LIFETIME_LIFO)
+    {
+        id=live.back();
+        live.pop_back();
+    }
+    else if(config.lifetimeModel==LIFETIME_FIFO)
+    {
+        id=live.front();
+        live.pop_front();
+    }
+    else
+    {
+        size_t i=below(live.size());
+        id=live[i];
+        live[i]=live.back();
+        live.pop_back();
+    }
+    return id;
+}
+
+
+
+// Each operation goes to a random thread; below that thread's share of liveTarget it allocates with probability 3/4,
+// above it with probability 1/4, so the live count ramps up and then hovers around the target
+
+void WorkloadGenerator::generate(TraceWriter &writer)
+{
+    int threads=max(1, config.threads);
+    vector<ThreadState> states(threads);
+    for(auto &thread:states)
+    {
+        thread.nextId=1;
+        thread.lastStrategy=config.strategies[0];
+    }
+    size_t target=max<int64_t>(1, config.liveTarget/threads);
+
+    writer.writeHeader(config.memorySize);
+    TraceOp op{};
+    for(int64_t i=0 ; i<config.operations ; i++)
+    {
+        op.thread=threads>1 ? (int)below(threads) : 0;
+        ThreadState &thread=states[op.thread];
+
+        size_t live=thread.live.size();
+        if(live>0 && config.reallocFraction>0 && unit()<config.reallocFraction)
+        {
+            op.type=OP_REALLOC;
+            op.strategy=thread.lastStrategy;
+            op.value=thread.live[below(live)];
+            op.size=drawSize();
+        }
+        else if(live==0 || unit()<(live<target ? 0.75 : 0.25))
+        {
+            op.type=OP_MALLOC;
+            op.strategy=config.strategies[below(config.strategies.size())];
+            op.value=drawSize();
+            thread.lastStrategy=op.strategy;
+
+            alloc_id_t id=thread.nextId++;
+            if(config.lifetimeModel!=LIFETIME_LONG_LIVED || unit()>=config.longLivedFraction)
+                thread.live.push_back(id);
+        }
+        else
+        {
+            op.type=OP_FREE;
+            op.value=takeLive(thread);
+        }
+        writer.write(op);
+    }
+}
@@ -0,0 +1,449 @@
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char TRACE_MAGIC[8]={'M', 'S', 'T', 'R', 'A', 'C', 'E', 1};
+
+TraceReader::TraceReader()
+{
+    data=nullptr;
+    pos=nullptr;
+    end=nullptr;
+    binary=false;
+    mappedLength=0;
+    memorySize=0;
+    threadCount=1;
+    line=1;
+}
+
+TraceReader::~TraceReader()
+{
+    if(mappedLength>0)
+        munmap((void*)data, mappedLength);
+}
+
+
+
+// Files are mapped read-only and parsed in place
+// stdin cannot be mapped, so it is read into one buffer up front
+
+bool TraceReader::open(const char *path)
+{
+    if(strcmp(path, "-")==0)
+    {
+        char chunk[1<<16];
+        size_t n;
+        while((n=fread(chunk, 1, sizeof(chunk), stdin))>0)
+            stdinBuffer.insert(stdinBuffer.end(), chunk, chunk+n);
+        data=stdinBuffer.data();
+        end=data+stdinBuffer.size();
+    }
+    else
+    {
+        int fd=::open(path, O_RDONLY);
+        if(fd<0)
+            return fail(string("cannot open ")+path);
+
+        struct stat st;
+        if(fstat(fd, &st)<0)
+        {
+            close(fd);
+            return fail(string("cannot stat ")+path);
+        }
+
+        if(st.st_size>0)
+        {
+            void *mapped=mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapped==MAP_FAILED)
+            {
+                close(fd);
+                return fail(string("cannot map ")+path);
+            }
+            madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+            data=(const char*)mapped;
+            mappedLength=st.st_size;
+        }
+        close(fd);
+        end=data+mappedLength;
+    }
+
+    pos=data;
+    if(end-data>=(ptrdiff_t)sizeof(TRACE_MAGIC) && memcmp(data, TRACE_MAGIC, sizeof(TRACE_MAGIC))==0)
+    {
+        binary=true;
+        line=0;
+        pos+=sizeof(TRACE_MAGIC);
+        if(!signedVarint(memorySize) || memorySize<=0)
+            return fail("trace must start with a positive memory size");
+        return true;
+    }
+    if(!number(memorySize) || memorySize<=0)
+        return fail("trace must start with a positive memory size");
+    return true;
+}
+
+
+
+void TraceReader::skipSpace()
+{
+    while(pos<end && (*pos==' ' || *pos=='\t' || *pos=='\r' || *pos=='\n'))
+    {
+        if(*pos=='\n')
+            line++;
+        pos++;
+    }
+}
+
+bool TraceReader::token(const char *&start, size_t &length)
+{
+    skipSpace();
+    start=pos;
+    while(pos<end && *pos!=' ' && *pos!='\t' && *pos!='\r' && *pos!='\n')
+        pos++;
+    length=pos-start;
+    return length>0;
+}
+
+bool TraceReader::number(int64_t &value)
+{
+    skipSpace();
+    bool negative=false;
+    if(pos<end && *pos=='-')
+    {
+        negative=true;
+        pos++;
+    }
+    if(pos>=end || *pos<'0' || *pos>'9')
+        return false;
+
+    int64_t result=0;
+    while(pos<end && *pos>='0' && *pos<='9')
+    {
+        int digit=*pos-'0';
+        if(result>(INT64_MAX-digit)/10)
+            return false;
+        result=result*10+digit;
+        pos++;
+    }
+    value=negative ? -result : result;
+    return true;
+}
+
+bool TraceReader::fail(const string &message)
+{
+    if(errorMessage.empty())
+        errorMessage="line "+to_string(line)+": "+message;
+    pos=end;
+    return false;
+}
+
+
+
+// Commands are matched on their length first, then compared in place
+
+static bool matches(const char *start, size_t length, const char *word)
+{
+    return length==strlen(word) && memcmp(start, word, length)==0;
+}
+
+bool TraceReader::next(TraceOp &op)
+{
+    op=TraceOp();
+    if(binary)
+        return nextBinary(op);
+
+    const char *start;
+    size_t length;
+    if(!token(start, length))
+        return false;
+
+    // Optional thread prefix t<N>, commands without one belong to thread 0
+    if(length>1 && start[0]=='t' && start[1]>='0' && start[1]<='9')
+    {
+        int thread=0;
+        for(size_t i=1 ; i<length ; i++)
+        {
+            if(start[i]<'0' || start[i]>'9' || thread>MAX_THREADS)
+                return fail("bad thread prefix "+string(start, length));
+            thread=thread*10+(start[i]-'0');
+        }
+        if(thread>=MAX_THREADS)
+            return fail("thread "+to_string(thread)+" is out of range");
+        op.thread=thread;
+        threadCount=max(threadCount, thread+1);
+        if(!token(start, length))
+            return fail("thread prefix without a command");
+    }
+    if((int)lastStrategy.size()<=op.thread)
+        lastStrategy.resize(op.thread+1, FIRST_FIT);
+
+    // memalign is a malloc followed by the alignment
+    bool aligned=matches(start, length, "memalign");
+    if(aligned || matches(start, length, "malloc"))
+    {
+        op.type=aligned ? OP_MEMALIGN : OP_MALLOC;
+        const char *command=aligned ? "memalign" : "malloc";
+        if(!token(start, length))
+            return fail(string(command)+" needs a strategy");
+        if(!parseStrategy(start, length, op.strategy))
+            return fail("unknown allocation type "+string(start, length));
+        if(!number(op.value))
+            return fail(string(command)+" needs a size");
+        if(aligned && !number(op.alignment))
+            return fail("memalign needs an alignment");
+        lastStrategy[op.thread]=op.strategy;
+    }
+    else if(matches(start, length, "realloc"))
+    {
+        op.type=OP_REALLOC;
+        op.strategy=lastStrategy[op.thread];
+        if(!number(op.value))
+            return fail("realloc needs an id");
+        if(!number(op.size))
+            return fail("realloc needs a size");
+    }
+    else if(matches(start, length, "free"))
+    {
+        op.type=OP_FREE;
+        if(!number(op.value))
+            return fail("free needs an id");
+    }
+    else if(matches(start, length, "slab"))
+    {
+        op.type=OP_SLAB;
+        if(!number(op.value))
+            return fail("slab needs a slab size");
+        slabClasses.clear();
+        if(op.value>INT32_MAX)
+            return fail("slab size is too large");
+        int64_t size;
+        while(true)
+        {
+            if(!number(size))
+                return fail("slab needs class sizes");
+            if(size>INT32_MAX)
+                return fail("slab class size is too large");
+            slabClasses.push_back(size);
+            if(pos<end && *pos==',')
+                pos++;
+            else
+                break;
+        }
+    }
+    else if(matches(start, length, "layout"))
+    {
+        op.type=OP_LAYOUT;
+        if(!number(op.value) || !number(op.size) || !number(op.alignment))
+            return fail("layout needs a header size, a footer size and an alignment");
+    }
+    else if(matches(start, length, "compact"))
+        op.type=OP_COMPACT;
+    else if(matches(start, length, "autocompact"))
+    {
+        op.type=OP_AUTOCOMPACT;
+        if(!token(start, length) || !(matches(start, length, "on") || matches(start, length, "off")))
+            return fail("autocompact needs on or off");
+        op.value=matches(start, length, "on") ? 1 : 0;
+    }
+    else if(matches(start, length, "dump"))
+        op.type=OP_DUMP;
+    else if(matches(start, length, "stats"))
+        op.type=OP_STATS;
+    else if(matches(start, length, "histogram"))
+        op.type=OP_HISTOGRAM;
+    else if(matches(start, length, "exit"))
+    {
+        op.type=OP_EXIT;
+        pos=end;
+    }
+    else
+        return fail("unknown command "+string(start, length));
+
+    return true;
+}
+
+
+
+// Binary records, see TRACE_MAGIC; line counts records so errors still point somewhere
+
+bool TraceReader::varint(uint64_t &value)
+{
+    value=0;
+    for(int shift=0 ; shift<64 ; shift+=7)
+    {
+        if(pos>=end)
+            return false;
+        uint8_t byte=(uint8_t)*pos++;
+        value|=(uint64_t)(byte&0x7F)<<shift;
+        if(!(byte&0x80))
+            return true;
+    }
+    return false;
+}
+
+bool TraceReader::signedVarint(int64_t &value)
+{
+    uint64_t raw;
+    if(!varint(raw))
+        return false;
+    value=(int64_t)(raw>>1)^-(int64_t)(raw&1);
+    return true;
+}
+
+bool TraceReader::nextBinary(TraceOp &op)
+{
+    if(pos>=end)
+        return false;
+    line++;
+
+    uint8_t header=(uint8_t)*pos++;
+    int type=header&0x0F;
+    int strategy=(header>>4)&0x07;
+    if(type>OP_LAYOUT || strategy>BUDDY)
+        return fail("bad record header");
+    op.type=(TraceOpType)type;
+    if(op.type==OP_MALLOC || op.type==OP_MEMALIGN || op.type==OP_REALLOC)
+        op.strategy=(AllocationStrategy)strategy;
+
+    if(header&0x80)
+    {
+        uint64_t thread;
+        if(!varint(thread) || thread>=(uint64_t)MAX_THREADS)
+            return fail("bad thread");
+        op.thread=(int)thread;
+        threadCount=max(threadCount, op.thread+1);
+    }
+
+    switch(op.type)
+    {
+        case OP_MALLOC:
+        case OP_FREE:
+        case OP_AUTOCOMPACT:
+            if(!signedVarint(op.value))
+                return fail("truncated record");
+            break;
+
+        case OP_REALLOC:
+            if(!signedVarint(op.value) || !signedVarint(op.size))
+                return fail("truncated record");
+            break;
+
+        case OP_MEMALIGN:
+            if(!signedVarint(op.value) || !signedVarint(op.alignment))
+                return fail("truncated record");
+            break;
+
+        case OP_LAYOUT:
+            if(!signedVarint(op.value) || !signedVarint(op.size) || !signedVarint(op.alignment))
+                return fail("truncated record");
+            break;
+
+        case OP_SLAB:
+        {
+            uint64_t count;
+            if(!signedVarint(op.value) || !varint(count))
+                return fail("truncated record");
+            if(op.value>INT32_MAX)
+                return fail("slab size is too large");
+            slabClasses.clear();
+            for(uint64_t i=0 ; i<count ; i++)
+            {
+                int64_t size;
+                if(!signedVarint(size))
+                    return fail("truncated record");
+                if(size>INT32_MAX)
+                    return fail("slab class size is too large");
+                slabClasses.push_back(size);
+            }
+            break;
+        }
+
+        case OP_EXIT:
+            pos=end;
+            break;
+
+        default:
+            break;
+    }
+    return true;
+}
+
+
+
+int TraceReader::getThreadCount() const
+{
+    return threadCount;
+}
+
+int64_t TraceReader::getMemorySize() const
+{
+    return memorySize;
+}
+
+const vector<int> &TraceReader::getSlabClasses() const
+{
+    return slabClasses;
+}
+
+bool TraceReader::failed() const
+{
+    return !errorMessage.empty();
+}
+
+const string &TraceReader::error() const
+{
+    return errorMessage;
+}
+
+
+
+bool parseStrategy(const char *name, size_t length, AllocationStrategy &strategy)
+{
+    if(matches(name, length, "firstFit"))      strategy=FIRST_FIT;
+    else if(matches(name, length, "nextFit"))  strategy=NEXT_FIT;
+    else if(matches(name, length, "bestFit"))  strategy=BEST_FIT;
+    else if(matches(name, length, "worstFit")) strategy=WORST_FIT;
+    else if(matches(name, length, "tlsf"))     strategy=TLSF;
+    else if(matches(name, length, "buddy"))    strategy=BUDDY;
+    else
+        return false;
+    return true;
+}
+
+bool parseStrategyList(const char *list, vector<AllocationStrategy> &strategies)
+{
+    while(*list)
+    {
+        const char *comma=strchr(list, ',');
+        size_t length=comma ? comma-list : strlen(list);
+        AllocationStrategy strategy;
+        if(!parseStrategy(list, length, strategy))
+            return false;
+        strategies.push_back(strategy);
+        list+=length;
+        if(*list==',')
+            list++;
+    }
+    return !strategies.empty();
+}
+
+const char *strategyName(AllocationStrategy strategy)
+{
+    switch(strategy)
+    {
+        case FIRST_FIT: return "firstFit";
+        case NEXT_FIT:  return "nextFit";
+        case BEST_FIT:  return "bestFit";
+        case WORST_FIT: return "worstFit";
+        case TLSF:      return "tlsf";
+        case BUDDY:     return "buddy";
+    }
+    return "unknown";
+}
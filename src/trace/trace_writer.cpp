@@ -0,0 +1,216 @@
+#include "trace.h"
+#include <cstring>
+
+using namespace std;
+
+static const size_t WRITE_BUFFER_SIZE=1<<20;
+
+TraceWriter::TraceWriter()
+{
+    file=nullptr;
+    binary=false;
+    ok=true;
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool TraceWriter::open(const char *path, bool binary)
+{
+    this->binary=binary;
+    file=strcmp(path, "-")==0 ? stdout : fopen(path, binary ? "wb" : "w");
+    buffer.reserve(WRITE_BUFFER_SIZE);
+    return file!=nullptr;
+}
+
+bool TraceWriter::close()
+{
+    if(!file)
+        return ok;
+    flush();
+    if(file==stdout)
+        ok=fflush(stdout)==0 && ok;
+    else
+        ok=fclose(file)==0 && ok;
+    file=nullptr;
+    return ok;
+}
+
+
+
+// Output is collected in one buffer and written in large blocks
+
+void TraceWriter::flush()
+{
+    if(!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file)!=buffer.size())
+        ok=false;
+    buffer.clear();
+}
+
+void TraceWriter::put(char c)
+{
+    buffer.push_back(c);
+    if(buffer.size()>=WRITE_BUFFER_SIZE)
+        flush();
+}
+
+void TraceWriter::putText(const char *text)
+{
+    while(*text)
+        put(*text++);
+}
+
+void TraceWriter::putNumber(int64_t value)
+{
+    char digits[24];
+    int n=0;
+    uint64_t magnitude=value<0 ? -(uint64_t)value : (uint64_t)value;
+    do
+    {
+        digits[n++]='0'+magnitude%10;
+        magnitude/=10;
+    } while(magnitude>0);
+    if(value<0)
+        put('-');
+    while(n>0)
+        put(digits[--n]);
+}
+
+void TraceWriter::putVarint(uint64_t value)
+{
+    while(value>=0x80)
+    {
+        put((char)((value&0x7F) | 0x80));
+        value>>=7;
+    }
+    put((char)value);
+}
+
+// Zigzag keeps small negative numbers short: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+
+void TraceWriter::putSignedVarint(int64_t value)
+{
+    putVarint(((uint64_t)value<<1) ^ (uint64_t)(value>>63));
+}
+
+
+
+void TraceWriter::writeHeader(int64_t memorySize)
+{
+    if(binary)
+    {
+        for(char c:TRACE_MAGIC)
+            put(c);
+        putSignedVarint(memorySize);
+    }
+    else
+    {
+        putNumber(memorySize);
+        put('\n');
+    }
+}
+
+void TraceWriter::write(const TraceOp &op, const vector<int> &slabClasses)
+{
+    if(binary)
+    {
+        bool hasStrategy=op.type==OP_MALLOC || op.type==OP_MEMALIGN || op.type==OP_REALLOC;
+        put((char)(op.type | (hasStrategy ? op.strategy<<4 : 0) | (op.thread!=0 ? 0x80 : 0)));
+        if(op.thread!=0)
+            putVarint(op.thread);
+        switch(op.type)
+        {
+            case OP_MALLOC:
+            case OP_FREE:
+            case OP_AUTOCOMPACT:
+                putSignedVarint(op.value);
+                break;
+            case OP_REALLOC:
+                putSignedVarint(op.value);
+                putSignedVarint(op.size);
+                break;
+            case OP_MEMALIGN:
+                putSignedVarint(op.value);
+                putSignedVarint(op.alignment);
+                break;
+            case OP_LAYOUT:
+                putSignedVarint(op.value);
+                putSignedVarint(op.size);
+                putSignedVarint(op.alignment);
+                break;
+            case OP_SLAB:
+                putSignedVarint(op.value);
+                putVarint(slabClasses.size());
+                for(int size:slabClasses)
+                    putSignedVarint(size);
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+
+    if(op.thread!=0)
+    {
+        put('t');
+        putNumber(op.thread);
+        put(' ');
+    }
+    switch(op.type)
+    {
+        case OP_MALLOC:
+            putText("malloc ");
+            putText(strategyName(op.strategy));
+            put(' ');
+            putNumber(op.value);
+            break;
+        case OP_MEMALIGN:
+            putText("memalign ");
+            putText(strategyName(op.strategy));
+            put(' ');
+            putNumber(op.value);
+            put(' ');
+            putNumber(op.alignment);
+            break;
+        case OP_FREE:
+            putText("free ");
+            putNumber(op.value);
+            break;
+        case OP_REALLOC:
+            putText("realloc ");
+            putNumber(op.value);
+            put(' ');
+            putNumber(op.size);
+            break;
+        case OP_SLAB:
+            putText("slab ");
+            putNumber(op.value);
+            put(' ');
+            for(size_t i=0 ; i<slabClasses.size() ; i++)
+            {
+                if(i>0)
+                    put(',');
+                putNumber(slabClasses[i]);
+            }
+            break;
+        case OP_LAYOUT:
+            putText("layout ");
+            putNumber(op.value);
+            put(' ');
+            putNumber(op.size);
+            put(' ');
+            putNumber(op.alignment);
+            break;
+        case OP_COMPACT:    putText("compact"); break;
+        case OP_AUTOCOMPACT:
+            putText(op.value==1 ? "autocompact on" : "autocompact off");
+            break;
+        case OP_DUMP:       putText("dump"); break;
+        case OP_STATS:      putText("stats"); break;
+        case OP_HISTOGRAM:  putText("histogram"); break;
+        case OP_EXIT:       putText("exit"); break;
+    }
+    put('\n');
+}
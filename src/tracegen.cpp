@@ -0,0 +1,199 @@
+// Synthetic allocation workload generator
+// Writes reproducible traces for memory-replay in the CLI command format or the binary trace format,
+// and converts existing traces between the two
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "trace.h"
+#include "trace_generator.h"
+
+using namespace std;
+
+static void usage()
+{
+    cerr<<"Usage: memory-tracegen [options]"<<endl;
+    cerr<<"  --ops <n>             number of commands (default: 1000000)"<<endl;
+    cerr<<"  --memory <n>          memory size written to the trace (default: 1073741824)"<<endl;
+    cerr<<"  --seed <n>            random seed, the same seed gives the same trace (default: 1)"<<endl;
+    cerr<<"  --size <model>        uniform:min:max | powerlaw:min:max:alpha | bimodal:small:large:smallFraction"<<endl;
+    cerr<<"                        | histogram:file (default: uniform:16:4096)"<<endl;
+    cerr<<"  --lifetime <model>    lifo | fifo | random | longlived[:fraction] (default: random)"<<endl;
+    cerr<<"  --live <n>            live allocations to hover around (default: 10000)"<<endl;
+    cerr<<"  --realloc <f>         fraction of commands that are reallocs (default: 0)"<<endl;
+    cerr<<"  --threads <n>         spread commands over n t<N> threads (default: 1)"<<endl;
+    cerr<<"  --strategy <s,s,...>  strategies mallocs pick from (default: firstFit)"<<endl;
+    cerr<<"  --binary              write the binary trace format"<<endl;
+    cerr<<"  --output <file|->     where to write the trace (default: -)"<<endl;
+    cerr<<"  --convert <file>      rewrite an existing trace instead of generating one"<<endl;
+}
+
+
+
+// Split "name:a:b:..." at the colons
+static vector<string> fields(const char *spec)
+{
+    vector<string> parts;
+    const char *start=spec;
+    for(const char *p=spec ; ; p++)
+    {
+        if(*p==':' || *p==0)
+        {
+            parts.push_back(string(start, p-start));
+            if(*p==0)
+                break;
+            start=p+1;
+        }
+    }
+    return parts;
+}
+
+static bool parseSizeModel(const char *spec, WorkloadConfig &config)
+{
+    vector<string> parts=fields(spec);
+    if(parts[0]=="uniform" && parts.size()==3)
+    {
+        config.sizeModel=SIZE_UNIFORM;
+        config.minSize=atoll(parts[1].c_str());
+        config.maxSize=atoll(parts[2].c_str());
+    }
+    else if(parts[0]=="powerlaw" && parts.size()==4)
+    {
+        config.sizeModel=SIZE_POWER_LAW;
+        config.minSize=atoll(parts[1].c_str());
+        config.maxSize=atoll(parts[2].c_str());
+        config.alpha=atof(parts[3].c_str());
+    }
+    else if(parts[0]=="bimodal" && parts.size()==4)
+    {
+        config.sizeModel=SIZE_BIMODAL;
+        config.smallSize=atoll(parts[1].c_str());
+        config.largeSize=atoll(parts[2].c_str());
+        config.smallFraction=atof(parts[3].c_str());
+        return config.smallSize>0 && config.largeSize>0;
+    }
+    else if(parts[0]=="histogram" && parts.size()==2)
+    {
+        config.sizeModel=SIZE_HISTOGRAM;
+        if(!loadSizeHistogram(parts[1], config.buckets))
+        {
+            cerr<<"memory-tracegen: no size buckets in "<<parts[1]<<endl;
+            return false;
+        }
+        return true;
+    }
+    else
+        return false;
+    return config.minSize>0 && config.maxSize>=config.minSize;
+}
+
+static bool parseLifetimeModel(const char *spec, WorkloadConfig &config)
+{
+    vector<string> parts=fields(spec);
+    if(parts[0]=="lifo" && parts.size()==1)            config.lifetimeModel=LIFETIME_LIFO;
+    else if(parts[0]=="fifo" && parts.size()==1)       config.lifetimeModel=LIFETIME_FIFO;
+    else if(parts[0]=="random" && parts.size()==1)     config.lifetimeModel=LIFETIME_RANDOM;
+    else if(parts[0]=="longlived" && parts.size()<=2)
+    {
+        config.lifetimeModel=LIFETIME_LONG_LIVED;
+        if(parts.size()==2)
+            config.longLivedFraction=atof(parts[1].c_str());
+    }
+    else
+        return false;
+    return true;
+}
+
+
+
+// Read a trace in either format and write every command back out, keeping thread prefixes
+
+static int convert(const char *input, TraceWriter &writer)
+{
+    TraceReader reader;
+    if(!reader.open(input))
+    {
+        cerr<<"memory-tracegen: "<<reader.error()<<endl;
+        return 1;
+    }
+
+    writer.writeHeader(reader.getMemorySize());
+    TraceOp op{};
+    while(reader.next(op))
+        writer.write(op, reader.getSlabClasses());
+    if(reader.failed())
+    {
+        cerr<<"memory-tracegen: "<<reader.error()<<endl;
+        writer.close();
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    WorkloadConfig config;
+    bool binary=false;
+    const char *output="-";
+    const char *input=NULL;
+    for(int i=1 ; i<argc ; i++)
+    {
+        bool hasValue=i+1<argc;
+        if(strcmp(argv[i], "--binary")==0) binary=true;
+        else if(strcmp(argv[i], "--ops")==0 && hasValue) config.operations=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--memory")==0 && hasValue) config.memorySize=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--seed")==0 && hasValue) config.seed=strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--live")==0 && hasValue) config.liveTarget=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--realloc")==0 && hasValue) config.reallocFraction=atof(argv[++i]);
+        else if(strcmp(argv[i], "--threads")==0 && hasValue) config.threads=atoi(argv[++i]);
+        else if(strcmp(argv[i], "--output")==0 && hasValue) output=argv[++i];
+        else if(strcmp(argv[i], "--convert")==0 && hasValue) input=argv[++i];
+        else if(strcmp(argv[i], "--size")==0 && hasValue && parseSizeModel(argv[i+1], config)) i++;
+        else if(strcmp(argv[i], "--lifetime")==0 && hasValue && parseLifetimeModel(argv[i+1], config)) i++;
+        else if(strcmp(argv[i], "--strategy")==0 && hasValue)
+        {
+            config.strategies.clear();
+            if(!parseStrategyList(argv[++i], config.strategies))
+            {
+                usage();
+                return 1;
+            }
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(config.operations<0 || config.memorySize<=0 || config.liveTarget<=0
+       || config.threads<1 || config.threads>TraceReader::MAX_THREADS)
+    {
+        usage();
+        return 1;
+    }
+
+    TraceWriter writer;
+    if(!writer.open(output, binary))
+    {
+        cerr<<"memory-tracegen: cannot write "<<output<<endl;
+        return 1;
+    }
+
+    if(input)
+    {
+        if(convert(input, writer)!=0)
+            return 1;
+    }
+    else
+    {
+        WorkloadGenerator generator(config);
+        generator.generate(writer);
+    }
+
+    if(!writer.close())
+    {
+        cerr<<"memory-tracegen: write to "<<output<<" failed"<<endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,295 @@
+// Allocator benchmarks
+// Measures ns per allocate/free call of every strategy against heap occupancy and against the free/alloc ratio,
+// and compares the medians with a baseline saved on the same machine to flag regressions
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "allocator.h"
+#include "trace.h"
+
+using namespace std;
+
+// Timings only compare within one machine, so the baseline is written locally with --save and never committed
+static const char *DEFAULT_BASELINE="bench_baseline.txt";
+static const int BATCH=256;                 // calls timed together, one percentile sample per batch
+static const mem_size_t MIN_SIZE=16;
+static const mem_size_t MAX_SIZE=256;
+
+struct BenchConfig {
+    int reps;
+    int64_t opsPerRep;
+    int64_t maxLive;
+};
+
+struct BenchResult {
+    string strategy;
+    string scenario;            // occupancy=<live blocks> or ratio=<frees per alloc>
+    double p50;
+    double p90;
+    double p99;
+    double mean;
+};
+
+// xorshift64*, so every run and every strategy sees the same sizes and victims
+struct Random {
+    uint64_t state;
+
+    Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        state^=state>>12;
+        state^=state<<25;
+        state^=state>>27;
+        return state*0x2545F4914F6CDD1DULL;
+    }
+
+    uint64_t below(uint64_t n)
+    {
+        return (uint64_t)(((unsigned __int128)next()*n)>>64);
+    }
+};
+
+// Room for blocks allocations of the largest size, twice over, rounded up to a power of two for the buddy allocator
+static mem_size_t heapFor(int64_t blocks)
+{
+    mem_size_t size=1<<20;
+    while(size<blocks*MAX_SIZE*2)
+        size<<=1;
+    return size;
+}
+
+static double percentile(const vector<double> &sorted, double p)
+{
+    size_t rank=(size_t)(p*sorted.size());
+    return sorted[min(rank, sorted.size()-1)];
+}
+
+
+
+// One benchmark: fill the heap with `live` blocks, run a warmup, then reps timed repetitions
+// Each call frees a random live block with probability freeShare and allocates otherwise;
+// freeShare < 0 alternates free and allocate exactly, keeping the occupancy fixed
+
+static BenchResult run(AllocationStrategy strategy, const string &scenario, int64_t live, double freeShare,
+                       const BenchConfig &config)
+{
+    int64_t calls=config.opsPerRep*(config.reps+1);
+    Allocator allocator(heapFor(live+(freeShare<0 ? 0 : calls)));
+    Random random(42);
+    vector<alloc_id_t> ids;
+    ids.reserve(live);
+    for(int64_t i=0 ; i<live ; i++)
+    {
+        alloc_id_t id=allocator.allocate(strategy, MIN_SIZE+random.below(MAX_SIZE-MIN_SIZE+1));
+        if(id!=-1)
+            ids.push_back(id);
+    }
+
+    bool freeNext=true;
+    auto step=[&]()
+    {
+        bool doFree;
+        if(freeShare<0)
+        {
+            doFree=freeNext;
+            freeNext=!freeNext;
+        }
+        else
+            doFree=(double)random.below(1000000)<freeShare*1000000;
+
+        if(doFree && !ids.empty())
+        {
+            size_t i=random.below(ids.size());
+            allocator.freeBlock(ids[i]);
+            ids[i]=ids.back();
+            ids.pop_back();
+        }
+        else
+        {
+            alloc_id_t id=allocator.allocate(strategy, MIN_SIZE+random.below(MAX_SIZE-MIN_SIZE+1));
+            if(id!=-1)
+                ids.push_back(id);
+        }
+    };
+
+    // The first repetition's worth of calls is the warmup and is not timed
+    for(int64_t i=0 ; i<config.opsPerRep ; i++)
+        step();
+
+    vector<double> samples;
+    double total=0;
+    for(int r=0 ; r<config.reps ; r++)
+    {
+        for(int64_t done=0 ; done<config.opsPerRep ; done+=BATCH)
+        {
+            int64_t batch=min<int64_t>(BATCH, config.opsPerRep-done);
+            auto start=chrono::steady_clock::now();
+            for(int64_t i=0 ; i<batch ; i++)
+                step();
+            double ns=chrono::duration<double, nano>(chrono::steady_clock::now()-start).count();
+            samples.push_back(ns/batch);
+            total+=ns;
+        }
+    }
+    sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.strategy=strategyName(strategy);
+    result.scenario=scenario;
+    result.p50=percentile(samples, 0.50);
+    result.p90=percentile(samples, 0.90);
+    result.p99=percentile(samples, 0.99);
+    result.mean=total/(config.opsPerRep*config.reps);
+    return result;
+}
+
+
+
+// Baseline files hold one "strategy scenario p50 p90 p99 mean" line per benchmark, # starts a comment
+
+static bool loadBaseline(const char *path, map<string, double> &medians)
+{
+    ifstream in(path);
+    if(!in)
+        return false;
+    string text;
+    while(getline(in, text))
+    {
+        if(text.empty() || text[0]=='#')
+            continue;
+        istringstream line(text);
+        string strategy, scenario;
+        double p50;
+        if(line>>strategy>>scenario>>p50)
+            medians[strategy+" "+scenario]=p50;
+    }
+    return true;
+}
+
+static bool saveBaseline(const char *path, const vector<BenchResult> &results, const BenchConfig &config)
+{
+    ofstream out(path);
+    if(!out)
+        return false;
+    out<<"# bench_allocator baseline, ns per call: strategy scenario p50 p90 p99 mean"<<endl;
+    out<<"# reps = "<<config.reps<<", calls per rep = "<<config.opsPerRep<<endl;
+    out<<fixed<<setprecision(1);
+    for(auto &result:results)
+        out<<result.strategy<<" "<<result.scenario<<" "<<result.p50<<" "<<result.p90<<" "<<result.p99<<" "<<result.mean<<endl;
+    return (bool)out;
+}
+
+static void usage()
+{
+    cerr<<"Usage: bench_allocator [options]"<<endl;
+    cerr<<"  --strategy <s,s,...>  strategies to measure (default: all)"<<endl;
+    cerr<<"  --reps <n>            timed repetitions per benchmark (default: 5)"<<endl;
+    cerr<<"  --ops <n>             calls per repetition, one more repetition is run as warmup (default: 20000)"<<endl;
+    cerr<<"  --max-live <n>        largest heap occupancy measured (default: 1000000)"<<endl;
+    cerr<<"  --baseline <file>     baseline saved on this machine to compare with (default: "<<DEFAULT_BASELINE<<")"<<endl;
+    cerr<<"  --threshold <f>       flag a median more than this fraction above the baseline (default: 0.25)"<<endl;
+    cerr<<"  --save <file>         write the results as a new baseline"<<endl;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config;
+    config.reps=5;
+    config.opsPerRep=20000;
+    config.maxLive=1000000;
+    const char *baselinePath=DEFAULT_BASELINE;
+    const char *savePath=NULL;
+    double threshold=0.25;
+    vector<AllocationStrategy> strategies;
+    for(int i=1 ; i<argc ; i++)
+    {
+        bool hasValue=i+1<argc;
+        if(strcmp(argv[i], "--reps")==0 && hasValue) config.reps=atoi(argv[++i]);
+        else if(strcmp(argv[i], "--ops")==0 && hasValue) config.opsPerRep=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--max-live")==0 && hasValue) config.maxLive=atoll(argv[++i]);
+        else if(strcmp(argv[i], "--baseline")==0 && hasValue) baselinePath=argv[++i];
+        else if(strcmp(argv[i], "--threshold")==0 && hasValue) threshold=atof(argv[++i]);
+        else if(strcmp(argv[i], "--save")==0 && hasValue) savePath=argv[++i];
+        else if(strcmp(argv[i], "--strategy")==0 && hasValue && parseStrategyList(argv[i+1], strategies)) i++;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(config.reps<1 || config.opsPerRep<1 || config.maxLive<1)
+    {
+        usage();
+        return 1;
+    }
+    if(strategies.empty())
+        strategies={FIRST_FIT, NEXT_FIT, BEST_FIT, WORST_FIT, TLSF, BUDDY};
+
+    map<string, double> baseline;
+    bool haveBaseline=loadBaseline(baselinePath, baseline);
+
+    cout<<left<<setw(10)<<"Strategy"<<setw(20)<<"Scenario"<<right<<setw(10)<<"p50 ns"<<setw(10)<<"p90 ns"
+        <<setw(10)<<"p99 ns"<<setw(10)<<"mean ns"<<setw(12)<<"baseline"<<setw(10)<<"change"<<endl;
+    cout<<fixed<<setprecision(1);
+
+    vector<BenchResult> results;
+    int regressions=0;
+    for(auto strategy:strategies)
+    {
+        vector<pair<string, pair<int64_t, double>>> scenarios;      // name, (live blocks, free share)
+        for(int64_t live=100 ; live<=config.maxLive ; live*=10)
+            scenarios.push_back({"occupancy="+to_string(live), {live, -1.0}});
+        int64_t ratioLive=min<int64_t>(10000, config.maxLive);
+        const char *ratioNames[]={"ratio=0.5", "ratio=1.0", "ratio=2.0"};
+        const double ratios[]={0.5, 1.0, 2.0};
+        for(int r=0 ; r<3 ; r++)
+            scenarios.push_back({ratioNames[r], {ratioLive, ratios[r]/(1+ratios[r])}});
+
+        for(auto &scenario:scenarios)
+        {
+            BenchResult result=run(strategy, scenario.first, scenario.second.first, scenario.second.second, config);
+            results.push_back(result);
+
+            cout<<left<<setw(10)<<result.strategy<<setw(20)<<result.scenario<<right<<setw(10)<<result.p50
+                <<setw(10)<<result.p90<<setw(10)<<result.p99<<setw(10)<<result.mean;
+            auto it=baseline.find(result.strategy+" "+result.scenario);
+            if(it!=baseline.end() && it->second>0)
+            {
+                double change=result.p50/it->second-1;
+                cout<<setw(12)<<it->second<<setw(9)<<showpos<<change*100<<noshowpos<<"%";
+                if(change>threshold)
+                {
+                    cout<<"  REGRESSION";
+                    regressions++;
+                }
+            }
+            cout<<endl;
+        }
+    }
+
+    if(!haveBaseline)
+        cout<<"No baseline at "<<baselinePath<<", save one on this machine with --save "<<baselinePath<<endl;
+    else
+        cout<<regressions<<" regression(s) beyond "<<threshold*100<<"% of "<<baselinePath<<endl;
+
+    if(savePath)
+    {
+        if(!saveBaseline(savePath, results, config))
+        {
+            cerr<<"bench_allocator: cannot write "<<savePath<<endl;
+            return 1;
+        }
+        cout<<"Baseline saved to "<<savePath<<endl;
+    }
+    return regressions>0 ? 2 : 0;
+}
@@ -1,5 +1,15 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <vector>
 #include "allocator.h"
+#include "fragmentation_sampler.h"
+#include "thread_arena.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -63,6 +73,101 @@ void test_worst_fit()
     cout<<endl;
 }
 
+void test_next_fit()
+{
+    cout<<"========== TEST: Next Fit =========="<<endl;
+
+    Allocator a(1000);
+
+    a.allocateNextFit(200);
+    a.allocateNextFit(100);
+    a.allocateNextFit(200);
+    a.allocateNextFit(90);
+    a.allocateNextFit(200);
+    a.freeBlock(2);
+    a.freeBlock(4);
+    a.dumpMemory();
+    a.allocateNextFit(80);     // continues after block 5
+    a.allocateNextFit(80);
+    a.allocateNextFit(80);     // only 50 left at the end, wraps around to the hole of block 2
+    a.dumpMemory();
+
+    cout<<endl;
+}
+
+void test_tlsf()
+{
+    cout<<"========== TEST: TLSF =========="<<endl;
+
+    Allocator a(1000);
+
+    a.allocateFirstFit(200);
+    a.allocateFirstFit(100);
+    a.allocateFirstFit(200);
+    a.allocateFirstFit(90);
+    a.allocateFirstFit(200);
+    a.freeBlock(2);
+    a.freeBlock(4);
+    a.dumpMemory();
+    a.allocateTlsf(80);        // bins at or above [80, 84): the 90 block comes first
+    a.allocateTlsf(100);       // rounded up to [100, 104), exactly the 100 block
+    a.allocateTlsf(150);       // rounded up to [152, 160), only the 210 block is in a higher bin
+    a.dumpMemory();
+
+    cout<<endl;
+}
+
+void test_buddy()
+{
+    cout<<"========== TEST: Buddy =========="<<endl;
+
+    Allocator a(1024);
+
+    a.allocateBuddy(100);      // 128 byte block
+    a.allocateBuddy(200);      // 256 byte block
+    a.allocateBuddy(60);       // 64 byte block
+    a.freeBlock(1);            // buddy of block 1 is split, no merge
+    a.allocateBuddy(30);       // 32 byte block
+    a.allocateBuddy(2000);     // larger than the pool: fails
+    a.allocateBuddy(((mem_size_t)1<<62)+1);     // past the largest order: fails instead of overflowing the rounding
+    a.dumpMemory();
+    a.printStats();
+    a.freeBlock(2);
+    a.freeBlock(3);
+    a.freeBlock(4);            // all buddies merge back into one block
+    a.dumpMemory();
+
+    cout<<endl;
+}
+
+void test_slab()
+{
+    cout<<"========== TEST: Slab =========="<<endl;
+
+    Allocator a(1000);
+
+    a.configureSlabs({16, 32, 64}, 128);
+    a.allocateFirstFit(10);    // class 16, carves the first slab
+    a.allocateFirstFit(20);    // class 32, carves a second slab
+    a.allocateFirstFit(30);    // class 32, same slab
+    a.allocateFirstFit(200);   // too large for any class, plain first fit
+    a.allocateBestFit(12);     // class 16, same slab as ID 1
+    a.dumpMemory();
+    a.printStats();
+    a.freeBlock(2);
+    a.freeBlock(3);            // class 32 slab is empty but kept for reuse
+    a.allocateFirstFit(64);    // class 64, carves a third slab
+    a.allocateFirstFit(50);
+    a.allocateFirstFit(40);    // third slab is full, carves a fourth
+    a.freeBlock(8);            // fourth slab is empty and kept
+    a.freeBlock(6);
+    a.freeBlock(7);            // third slab is empty too, handed back to the heap
+    a.dumpMemory();
+    a.printStats();
+
+    cout<<endl;
+}
+
 void test_free_and_coalesce()
 {
     cout<<"========== TEST: Free and Coalescing =========="<<endl;
@@ -102,6 +207,30 @@ void test_fragmentation()
     cout<<endl;
 }
 
+void test_free_histogram()
+{
+    cout<<"========== TEST: Free Block Histogram =========="<<endl;
+
+    Allocator a(1000);
+
+    a.allocateFirstFit(200);
+    a.allocateFirstFit(100);
+    a.allocateFirstFit(200);
+    a.allocateFirstFit(90);
+    a.allocateFirstFit(200);
+    a.freeBlock(1);
+    a.freeBlock(3);
+    a.printFreeHistogram();
+    a.freeBlock(2);            // coalesces 200 + 100 + 200 into 500
+    a.printFreeHistogram();
+
+    AllocatorStats stats=a.getStats();
+    cout<<"Free Bytes = "<<stats.freeBytes<<", Free Blocks = "<<stats.freeBlocks
+        <<", Largest Free Block = "<<stats.largestFreeBlock<<endl;
+
+    cout<<endl;
+}
+
 void test_allocation_failure()
 {
     cout<<"========== TEST: Allocation Failure =========="<<endl;
@@ -124,6 +253,358 @@ void test_allocation_failure()
     cout<<endl;
 }
 
+void test_invalid_free()
+{
+    cout<<"========== TEST: Invalid Free =========="<<endl;
+
+    Allocator a(1000);
+
+    a.allocateFirstFit(200);
+    a.allocateFirstFit(100);
+    cout<<"free 1 -> "<<(a.freeBlock(1) ? "freed" : "rejected")<<endl;
+    cout<<"free 1 -> "<<(a.freeBlock(1) ? "freed" : "rejected")<<endl;   // double free
+    cout<<"free 7 -> "<<(a.freeBlock(7) ? "freed" : "rejected")<<endl;   // never allocated
+    cout<<"free -1 -> "<<(a.freeBlock(-1) ? "freed" : "rejected")<<endl; // ID of a free block
+    a.dumpMemory();
+
+    cout<<endl;
+}
+
+void test_realloc()
+{
+    cout<<"========== TEST: Realloc =========="<<endl;
+
+    Allocator a(1000);
+
+    a.allocateFirstFit(200);
+    a.allocateFirstFit(100);
+    a.allocateFirstFit(200);
+    a.freeBlock(2);
+    a.reallocate(1, 250);           // grows into the free 100 block
+    a.reallocate(3, 120);           // shrinks, the tail merges with the free space above
+    a.dumpMemory();
+    a.reallocate(1, 400);           // next block is used, moves first fit
+    a.reallocate(3, 600, BEST_FIT); // nothing fits
+    a.dumpMemory();
+    a.printStats();
+
+    cout<<endl;
+}
+
+void test_compaction()
+{
+    cout<<"========== TEST: Compaction =========="<<endl;
+
+    Allocator a(1000);
+
+    a.configureSlabs({32}, 128);
+    a.allocateFirstFit(200);
+    a.allocateFirstFit(100);
+    a.allocateFirstFit(20);     // slab object
+    a.allocateFirstFit(200);
+    a.allocateBuddy(30);
+    a.allocateFirstFit(90);
+    a.freeBlock(2);
+    a.freeBlock(4);
+    a.dumpMemory();
+
+    CompactionResult result=a.compact();
+    for(auto &relocation:result.relocations)
+        cout<<"ID "<<relocation.id<<": "<<relocation.oldStart<<" -> "<<relocation.newStart<<endl;
+    cout<<"Bytes moved = "<<result.bytesMoved<<endl;
+    a.dumpMemory();
+
+    a.allocateFirstFit(400);    // fails, the free space is one 326-byte block
+    a.setAutoCompact(true);
+    a.freeBlock(1);
+    a.allocateWorstFit(400);    // no single hole fits, compacts and succeeds
+    a.dumpMemory();
+    a.printStats();
+
+    cout<<endl;
+}
+
+void test_large_heap()
+{
+    cout<<"========== TEST: Large Heap (8 GiB) =========="<<endl;
+
+    Allocator a(8589934592LL);
+
+    a.allocateFirstFit(3221225472LL);   // 3 GiB
+    a.allocateFirstFit(2147483648LL);   // 2 GiB
+    a.allocateFirstFit(1073741824LL);   // 1 GiB
+    a.freeBlock(2);
+    a.allocateBestFit(1073741824LL);
+    a.allocateWorstFit(2147483648LL);
+    a.allocateTlsf(536870912LL);
+    a.allocateBuddy(4096);
+    a.dumpMemory();
+    a.printStats();
+    a.printFreeHistogram();
+    a.freeBlock(1);
+    a.freeBlock(3);
+    a.freeBlock(4);
+    a.freeBlock(5);
+    a.freeBlock(6);
+    a.freeBlock(7);
+    a.dumpMemory();
+
+    cout<<endl;
+}
+
+void test_thread_arenas()
+{
+    cout<<"========== TEST: Thread Arenas =========="<<endl;
+
+    SharedHeap shared(262144, 1024);
+    vector<unique_ptr<ThreadArena>> arenas;
+    for(int t=0 ; t<4 ; t++)
+        arenas.emplace_back(new ThreadArena(shared));
+
+    // Each thread only touches its own arena, so the results do not depend on scheduling
+    vector<thread> workers;
+    for(int t=0 ; t<4 ; t++)
+        workers.emplace_back([&arenas, t]()
+        {
+            ThreadArena &arena=*arenas[t];
+            for(int i=1 ; i<=200 ; i++)
+                arena.allocate(FIRST_FIT, 16*(t+1)+i%50);
+            arena.allocate(FIRST_FIT, 2048);    // larger than a chunk, fails
+            for(int i=1 ; i<=200 ; i+=2)
+                arena.freeBlock(i);
+            arena.reallocate(2, 900, BEST_FIT);
+            for(int i=2 ; i<=200 ; i+=2)
+                arena.freeBlock(i);
+        });
+    for(auto &worker:workers)
+        worker.join();
+
+    int held=0;
+    for(int t=0 ; t<4 ; t++)
+    {
+        ArenaStats stats=arenas[t]->getStats();
+        held+=stats.chunks;
+        cout<<"Arena "<<t<<" : allocations = "<<stats.allocRequests<<" ("<<stats.allocFailures<<" failed)"
+            <<", frees = "<<stats.frees<<", reallocations = "<<stats.reallocs
+            <<", refills = "<<stats.refills<<", returned = "<<stats.chunksReturned
+            <<", chunks = "<<stats.chunks<<" (peak "<<stats.peakChunks<<"), used = "<<stats.usedBytes<<endl;
+    }
+    cout<<"Shared chunks in use = "<<shared.chunksInUse()<<", held by arenas = "<<held<<endl;
+
+    cout<<endl;
+}
+
+// Same observable state: totals, free blocks and histogram
+
+static bool sameState(const Allocator &a, const Allocator &b)
+{
+    AllocatorStats sa=a.getStats(), sb=b.getStats();
+    return sa.usedBytes==sb.usedBytes && sa.freeBlocks==sb.freeBlocks && sa.largestFreeBlock==sb.largestFreeBlock
+        && sa.internalFragmentation==sb.internalFragmentation && sa.allocRequests==sb.allocRequests
+        && a.getFreeHistogram()==b.getFreeHistogram();
+}
+
+void test_snapshot()
+{
+    cout<<"========== TEST: Snapshot =========="<<endl;
+
+    const char *path="test_snapshot.bin";
+    Allocator a(4096);
+
+    a.configureSlabs({32, 64}, 256);
+    a.allocateFirstFit(300);
+    a.allocateFirstFit(20);     // slab object
+    a.allocateBuddy(100);
+    a.allocateBestFit(500);
+    a.allocateTlsf(40);         // slab object
+    a.allocateNextFit(700);
+    a.freeBlock(1);
+    a.freeBlock(5);
+    a.reallocate(4, 200);
+    a.saveSnapshot(path);
+    ifstream file(path, ios::binary);
+    string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    Allocator b(1);
+    b.loadSnapshot(path);
+    remove(path);
+    b.dumpMemory();
+    b.printStats();
+
+    // Both must make the same decisions from here on
+    a.allocateFirstFit(250);
+    b.allocateFirstFit(250);
+    a.allocateBuddy(60);
+    b.allocateBuddy(60);
+    a.allocateFirstFit(30);
+    b.allocateFirstFit(30);
+    a.freeBlock(2);
+    b.freeBlock(2);
+    cout<<"Restored allocator matches original = "<<(sameState(a, b) ? "yes" : "no")<<endl;
+    b.dumpMemory();
+
+    cout<<"Missing snapshot loads = "<<(b.loadSnapshot(path) ? "yes" : "no")<<endl;
+
+    // Flip each byte of the first snapshot in turn: links, counts and sizes that no longer fit together are rejected,
+    // and a rejected load must leave the allocator as it was. Flipped counters and padding still load,
+    // after which b is brought back to a's state
+    const char *currentPath="test_snapshot_current.bin";
+    a.saveSnapshot(currentPath);
+    int rejected=0;
+    bool unchanged=true;
+    for(size_t i=sizeof(SNAPSHOT_MAGIC) ; i<bytes.size() ; i++)
+    {
+        string corrupted=bytes;
+        corrupted[i]^=0xFF;
+        ofstream(path, ios::binary)<<corrupted;
+        if(b.loadSnapshot(path))
+            b.loadSnapshot(currentPath);
+        else
+        {
+            rejected++;
+            unchanged=unchanged && sameState(a, b);
+        }
+    }
+    remove(path);
+    remove(currentPath);
+    cout<<"Corrupted snapshots rejected = "<<rejected<<" of "<<bytes.size()-sizeof(SNAPSHOT_MAGIC)<<endl;
+    cout<<"Allocator unchanged by rejected loads = "<<(unchanged ? "yes" : "no")<<endl;
+
+    cout<<endl;
+}
+
+void test_fragmentation_sampler()
+{
+    cout<<"========== TEST: Fragmentation Sampler =========="<<endl;
+
+    Allocator a(1000);
+    FragmentationSampler sampler(3, 3);     // every 3 operations, keeps the last 3 samples
+
+    for(int i=1 ; i<=6 ; i++)
+        sampler.record(a, a.allocateFirstFit(100)==-1);
+    sampler.record(a, !a.freeBlock(2));
+    sampler.record(a, !a.freeBlock(4));
+    sampler.record(a, a.allocateFirstFit(500)==-1);    // fails
+    sampler.record(a, !a.freeBlock(5));
+    sampler.record(a, a.allocateBestFit(150)==-1);
+    sampler.record(a, a.allocateFirstFit(500)==-1);    // fails
+    sampler.writeCsv(cout);
+    cout<<"Samples = "<<sampler.size()<<" ("<<sampler.dropped()<<" overwritten)"<<endl;
+
+    cout<<endl;
+}
+
+void test_block_layout()
+{
+    cout<<"========== TEST: Block Layout =========="<<endl;
+
+    Allocator a(1000);
+
+    a.configureLayout(8, 8, 16);    // 8-byte header and footer, payloads aligned to 16
+    a.allocateFirstFit(100);
+    a.allocateFirstFit(50, 64);
+    a.allocateBestFit(30);
+    a.freeBlock(1);
+    a.allocateWorstFit(10);
+    a.dumpMemory();
+    a.printStats();
+    a.reallocate(2, 20);            // shrinks in place, the padding stays
+    a.compact();                    // padding is redone at the new addresses
+    a.dumpMemory();
+    a.printStats();
+    cout<<"Layout change with live blocks accepted = "<<(a.configureLayout(0, 0, 1) ? "yes" : "no")<<endl;
+
+    cout<<endl;
+}
+
+void test_aligned_fit()
+{
+    cout<<"========== TEST: Aligned Fit =========="<<endl;
+
+    // A block exactly large enough fits when its start needs no padding
+    AllocationStrategy strategies[5]={FIRST_FIT, NEXT_FIT, BEST_FIT, WORST_FIT, TLSF};
+    const char *names[5]={"First Fit", "Next Fit", "Best Fit", "Worst Fit", "TLSF"};
+    for(int s=0 ; s<5 ; s++)
+    {
+        Allocator exact(64);
+        Allocator aligned(16);
+        aligned.configureLayout(0, 0, 8);
+        cout<<names[s]<<": 64 aligned to 16 in 64 bytes = "<<(exact.allocate(strategies[s], 64, 16)!=-1 ? "ok" : "failed")
+            <<", 16 aligned to 8 in 16 bytes = "<<(aligned.allocate(strategies[s], 16)!=-1 ? "ok" : "failed")<<endl;
+    }
+
+    // The free block [8 - 31] is large enough for 20 bytes but not for the 8 bytes of padding in front of them
+    Allocator a(256);
+    a.allocateFirstFit(8);
+    a.allocateFirstFit(24);
+    a.allocateFirstFit(8);
+    a.freeBlock(2);
+    a.allocateFirstFit(20, 16);     // payload at 48
+    a.allocateFirstFit(16, 8);      // fits [8 - 31] without padding
+    a.dumpMemory();
+
+    cout<<endl;
+}
+
+// Read path and write it back out in the other format
+static void convertTrace(const char *from, const char *to, bool binary)
+{
+    TraceReader reader;
+    reader.open(from);
+    TraceWriter writer;
+    writer.open(to, binary);
+    writer.writeHeader(reader.getMemorySize());
+
+    // Fields left over from a previous command must not leak into the next record
+    TraceOp op;
+    memset((void*)&op, 0xAB, sizeof(op));
+    while(reader.next(op))
+        writer.write(op, reader.getSlabClasses());
+    writer.close();
+    if(reader.failed())
+        cout<<"Conversion failed: "<<reader.error()<<endl;
+}
+
+void test_trace_round_trip()
+{
+    cout<<"========== TEST: Trace Round Trip =========="<<endl;
+
+    // Starts with commands that carry no strategy, and covers every command with numbers
+    const char *text=
+        "4096\n"
+        "slab 128 32,64\n"
+        "free 3\n"
+        "layout 8 8 16\n"
+        "malloc bestFit 100\n"
+        "t2 memalign tlsf 50 64\n"
+        "realloc 1 200\n"
+        "t1 free 1\n"
+        "autocompact on\n"
+        "compact\n"
+        "dump\n"
+        "stats\n"
+        "histogram\n"
+        "exit\n";
+    const char *textPath="test_trace.txt", *binaryPath="test_trace.bin", *backPath="test_trace_back.txt";
+    {
+        ofstream out(textPath);
+        out<<text;
+    }
+
+    convertTrace(textPath, binaryPath, true);
+    convertTrace(binaryPath, backPath, false);
+
+    ifstream in(backPath);
+    stringstream back;
+    back<<in.rdbuf();
+    remove(textPath);
+    remove(binaryPath);
+    remove(backPath);
+
+    cout<<"Text -> binary -> text identical = "<<(back.str()==text ? "yes" : "no")<<endl;
+    cout<<endl;
+}
+
 int main()
 {
     cout<<"Running Allocator Tests"<<endl<<endl;
@@ -131,9 +612,24 @@ int main()
     test_first_fit();
     test_best_fit();
     test_worst_fit();
+    test_next_fit();
+    test_tlsf();
+    test_buddy();
+    test_slab();
     test_free_and_coalesce();
     test_fragmentation();
+    test_free_histogram();
     test_allocation_failure();
+    test_invalid_free();
+    test_realloc();
+    test_compaction();
+    test_large_heap();
+    test_thread_arenas();
+    test_snapshot();
+    test_fragmentation_sampler();
+    test_block_layout();
+    test_aligned_fit();
+    test_trace_round_trip();
 
     cout<<"All tests executed"<<endl;
     return 0;
@@ -1,6 +1,11 @@
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <vector>
+#include "address_trace.h"
 #include "cache_simulator.h"
 #include "cache_level.h"
+#include "tag_lookup.h"
 
 using namespace std;
 
@@ -43,6 +48,27 @@ CacheSimulator buildCache_LRU()
     return CacheSimulator(L1, L2);
 }
 
+// 4-way L1 for the policies that need more than two ways to differ from LRU
+// Addresses that are multiples of 16 all map to L1 set 0
+CacheSimulator buildCache_policy(ReplacementPolicy policy)
+{
+    CacheLevel L1(
+        64,     // cache size
+        4,      // block size
+        4,      // associativity
+        policy  // replacement policy
+    );
+
+    CacheLevel L2(
+        128,
+        4,
+        4,
+        policy
+    );
+
+    return CacheSimulator(L1, L2);
+}
+
 void test_basic_hits()
 {
     cout<<"========== TEST: Basic Hits =========="<<endl;
@@ -123,6 +149,330 @@ void test_stats_reset()
     cout<<endl;
 }
 
+void test_tree_PLRU()
+{
+    cout<<"========== TEST: Tree PLRU =========="<<endl;
+
+    CacheSimulator cache=buildCache_policy(TREE_PLRU);
+
+    cache.access(0);
+    cache.access(16);
+    cache.access(32);
+    cache.access(48);    // Set 0 full
+    cache.access(48);    // L1 hit, tree points at the left half
+    cache.access(0);     // L1 hit, left node points away from 0 -> 16
+    cache.access(64);    // Root points right, right node points to 32 -> 32 demoted (LRU would demote 16)
+    cache.access(16);    // L1 hit
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_SRRIP()
+{
+    cout<<"========== TEST: SRRIP =========="<<endl;
+
+    CacheSimulator cache=buildCache_policy(SRRIP);
+
+    cache.access(0);
+    cache.access(16);
+    cache.access(32);
+    cache.access(48);    // Set 0 full, every block predicted long
+    cache.access(0);     // L1 hit, 0 predicted near
+    cache.access(64);
+    cache.access(80);
+    cache.access(96);
+    cache.access(112);   // Scanned blocks replace each other and 16, 32, 48, 0 survives (LRU would demote it)
+    cache.access(0);     // L1 hit
+    cache.access(32);    // L2 hit
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_BRRIP()
+{
+    cout<<"========== TEST: BRRIP =========="<<endl;
+
+    CacheSimulator cache=buildCache_policy(BRRIP);
+
+    cache.access(0);     // First insertion predicted long, the next 31 distant
+    cache.access(16);
+    cache.access(32);
+    cache.access(48);
+    cache.access(0);     // L1 hit
+    cache.access(64);
+    cache.access(80);
+    cache.access(96);
+    cache.access(112);   // Each scanned block replaces the previous one in the same way
+    cache.access(0);     // L1 hit
+    cache.access(32);    // L1 hit, not demoted by the scan
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_LFU()
+{
+    cout<<"========== TEST: LFU =========="<<endl;
+
+    CacheSimulator cache=buildCache_policy(LFU);
+
+    cache.access(0);
+    cache.access(16);
+    cache.access(32);
+    cache.access(48);
+    cache.access(16);
+    cache.access(16);
+    cache.access(32);
+    cache.access(0);     // Counts: 0 -> 2, 16 -> 3, 32 -> 2, 48 -> 1
+    cache.access(64);    // 48 demoted
+    cache.access(48);    // L2 hit, 64 has the lowest count and is demoted
+    cache.access(16);    // L1 hit
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_random()
+{
+    cout<<"========== TEST: Random =========="<<endl;
+
+    // Victims come from a fixed-seed generator, so the result is the same on every run
+    CacheSimulator cache=buildCache_policy(RANDOM);
+
+    for(int round=0 ; round<3 ; round++)
+    {
+        for(int address=0 ; address<128 ; address+=16)
+            cache.access(address);
+    }
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_inclusive()
+{
+    cout<<"========== TEST: Inclusive L2 =========="<<endl;
+
+    // Direct-mapped inclusive L2: its evictions back-invalidate L1
+    CacheSimulator cache(CacheLevel(64, 4, 2, FIFO), CacheLevel(32, 4, 1, FIFO, INCLUSIVE));
+
+    cache.access(0);     // Filled into L2 and L1
+    cache.access(32);    // Same L2 set: 0 evicted from L2 and back-invalidated from L1
+    cache.access(0);     // Misses both levels
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_NINE()
+{
+    cout<<"========== TEST: Non-Inclusive Non-Exclusive L2 =========="<<endl;
+
+    CacheSimulator cache(CacheLevel(64, 4, 2, FIFO), CacheLevel(32, 4, 1, FIFO, NINE));
+
+    cache.access(0);
+    cache.access(32);    // 0 evicted from L2 only
+    cache.access(0);     // L1 hit
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_three_levels()
+{
+    cout<<"========== TEST: Three Levels =========="<<endl;
+
+    // L1, a victim L2 exclusive of it and an L3 inclusive of the L2
+    // Addresses that are multiples of 32 map to set 0 of L1 and L2
+    vector<CacheLevel> levels={
+        CacheLevel(64, 4, 2, FIFO),
+        CacheLevel(64, 4, 2, FIFO, EXCLUSIVE),
+        CacheLevel(256, 4, 4, FIFO, INCLUSIVE)
+    };
+    CacheSimulator cache(levels);
+
+    cache.access(0);
+    cache.access(32);
+    cache.access(64);    // Filled into L3 and L1, 0 demoted to L2
+    cache.access(0);     // L2 hit, promoted to L1, 32 demoted to L2
+    cache.access(96);    // 64 demoted to L2
+    cache.access(128);   // 0 demoted to L2, 32 evicted from L2 but kept by L3
+    cache.access(32);    // L3 hit, filled into L1 only
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_write_back()
+{
+    cout<<"========== TEST: Write-Back =========="<<endl;
+
+    CacheSimulator cache=buildCache();
+
+    cache.access(0, WRITE);     // Write-allocate: filled into L1 and marked dirty
+    cache.access(32);
+    cache.access(64);           // Dirty 0 demoted to L2: L1 -> L2 writeback
+    cache.access(32, WRITE);    // L1 Hit, 32 now dirty
+    cache.access(96);           // Dirty 32 demoted to L2: L1 -> L2 writeback
+    cache.access(0);            // L2 Hit, 0 promoted to L1 still dirty
+    cache.access(128);
+    cache.access(160);          // Dirty 0 demoted again: L1 -> L2 writeback
+    cache.access(192);          // L2 set full, dirty 32 evicted: L2 -> Memory writeback
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_write_through()
+{
+    cout<<"========== TEST: Write-Through =========="<<endl;
+
+    // Write-through, no-allocate L1 over a write-back NINE L2
+    CacheSimulator cache(CacheLevel(64, 4, 2, FIFO, EXCLUSIVE, WRITE_THROUGH), CacheLevel(128, 4, 4, FIFO, NINE));
+
+    cache.access(0, WRITE);     // No allocation in L1, L2 allocates and absorbs the store
+    cache.access(0);            // L2 Hit, filled into L1
+    cache.access(0, WRITE);     // L1 Hit, store written through to L2
+    cache.access(32, WRITE);    // Allocated in L2 only
+    cache.access(64);
+    cache.access(96);
+    cache.access(128);          // Dirty 0 evicted from L2: L2 -> Memory writeback
+
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_tag_lookup()
+{
+    cout<<"========== TEST: Tag Lookup Kernels =========="<<endl;
+
+    // Every kernel the CPU supports must find the same way as the scalar loop,
+    // for sets that end inside a vector as well as on a vector boundary
+    vector<TagLookup> kernels=supportedTagLookups();
+    int mismatches=0;
+    for(int ways=1 ; ways<=40 ; ways++)
+    {
+        vector<int> tags(ways);
+        for(int way=0 ; way<ways ; way++)
+            tags[way]=way*7+3;
+        tags[ways/2]=(int)CacheLevel::EMPTY_LINE;
+
+        for(int tag=-1 ; tag<ways*7+3 ; tag++)
+        {
+            int expected=findTagScalar(tags.data(), ways, tag);
+            for(auto kernel:kernels)
+            {
+                if(kernel(tags.data(), ways, tag)!=expected)
+                    mismatches++;
+            }
+        }
+    }
+
+    cout<<"Kernel mismatches : "<<mismatches<<endl;
+    cout<<endl;
+}
+
+void test_address_trace()
+{
+    cout<<"========== TEST: Address Trace Formats =========="<<endl;
+
+    // A lackey trace mixing in plain hex lines, written out in both binary formats and read back
+    const char *textPath="test_trace.txt";
+    const char *binaryPaths[2]={"test_trace_fixed.bin", "test_trace_delta.bin"};
+    FILE *file=fopen(textPath, "w");
+    fputs("==42== Lackey output\n"
+          "I  0400d7d4,8\n"
+          " L 1ffefffd38,8\n"
+          " S 1ffefffd30,4\n"
+          " M 0421c7f0,4\n"
+          "0x40\n"
+          "3fffffffffffffff\n", file);
+    fclose(file);
+
+    vector<AddressAccess> text(16);
+    AddressTraceReader reader;
+    reader.open(textPath);
+    text.resize(reader.read(text.data(), text.size()));
+    remove(textPath);
+    cout<<"Text records : "<<text.size()<<endl;
+
+    int mismatches=0;
+    AddressTraceFormat formats[2]={ADDRESS_FIXED, ADDRESS_DELTA};
+    for(int f=0 ; f<2 ; f++)
+    {
+        AddressTraceWriter writer;
+        writer.open(binaryPaths[f], formats[f]);
+        for(auto &record:text)
+            writer.write(record.address, record.type);
+        writer.close();
+
+        vector<AddressAccess> binary(16);
+        AddressTraceReader binaryReader;
+        binaryReader.open(binaryPaths[f]);
+        binary.resize(binaryReader.read(binary.data(), binary.size()));
+        remove(binaryPaths[f]);
+
+        if(binaryReader.getFormat()!=formats[f] || binary.size()!=text.size())
+            mismatches++;
+        for(size_t i=0 ; i<binary.size() && i<text.size() ; i++)
+        {
+            if(binary[i].address!=text[i].address || binary[i].type!=text[i].type)
+                mismatches++;
+        }
+    }
+    cout<<"Format mismatches : "<<mismatches<<endl;
+
+    // Bits 62 and 63 do not fit the binary formats, so such an address is rejected rather than truncated
+    file=fopen(textPath, "w");
+    fputs("40\n4000000000000000\n", file);
+    fclose(file);
+    AddressTraceReader wideReader;
+    wideReader.open(textPath);
+    AddressAccess wide[4];
+    size_t wideCount=wideReader.read(wide, 4);
+    remove(textPath);
+    cout<<"Address above bit 61 : "<<(wideReader.failed() ? wideReader.error() : "accepted")<<", "<<wideCount<<" read"<<endl;
+
+    // The M record is a read followed by a write hit
+    CacheSimulator cache=buildCache();
+    for(auto &record:text)
+        cache.access(record.address, record.type);
+    cache.printStats();
+    cout<<endl;
+}
+
+void test_wide_addresses()
+{
+    cout<<"========== TEST: 64-bit Addresses =========="<<endl;
+
+    CacheSimulator cache=buildCache();
+
+    // Block addresses 1<<32, 2<<32 and 3<<32 share their low 32 bits with block 0 and all map to set 0
+    const uint64_t A=(uint64_t)1<<34, B=(uint64_t)2<<34, C=(uint64_t)3<<34;
+    cache.access(A);
+    cache.access(B);
+    cache.access(A);     // L1 hit, B is not mistaken for A
+    cache.access(B);     // L1 hit
+    cache.access(C);     // L1 set 0 full: A demoted to L2
+    cache.access(A);     // L2 hit, promoted back: B demoted
+    cache.access(0);     // Miss everywhere, C demoted
+
+    cache.printStats();
+    cout<<endl;
+
+    // With 1-byte blocks the last address of the space is also the block address unused lines hold
+    CacheSimulator top({CacheLevel(4, 1, 4, LRU)});
+    top.access(UINT64_MAX);    // Miss, not mistaken for an unused line
+    top.access(UINT64_MAX);    // L1 hit
+    top.access(0);
+    top.access(UINT64_MAX);    // L1 hit
+
+    top.printStats();
+    cout<<endl;
+}
+
 int main()
 {
     cout<<"Running Cache Simulator Tests"<<endl<<endl;
@@ -132,6 +482,19 @@ int main()
     test_FIFO();
     test_LRU();
     test_stats_reset();
+    test_tree_PLRU();
+    test_SRRIP();
+    test_BRRIP();
+    test_LFU();
+    test_random();
+    test_inclusive();
+    test_NINE();
+    test_three_levels();
+    test_write_back();
+    test_write_through();
+    test_tag_lookup();
+    test_address_trace();
+    test_wide_addresses();
 
     cout<<"All cache tests executed"<<endl;
     return 0;